@@ -0,0 +1,58 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+// Rendering and input backend. The UI core in main.c only talks to one of
+// these: X11 for the real window, or headless (in-memory framebuffer and
+// scripted input) for CI machines and profiling without a display.
+
+// UI palette; backends map the indices to native colors. COL_ANSI + n is
+// ANSI colour n (0-7, then the bright 8-15) for output that sets colours.
+enum { COL_BG, COL_FG, COL_TAB_ACTIVE, COL_TAB_INACTIVE, COL_ACCENT, COL_ANSI, COL_COUNT = COL_ANSI + 16 };
+
+// Key codes: printable ASCII keys report their lowercase character,
+// everything else the UI cares about uses the codes below.
+enum {
+    KEY_NONE = 0,
+    KEY_RETURN = 0x100, KEY_KP_ENTER, KEY_ESCAPE, KEY_BACKSPACE, KEY_TAB,
+    KEY_LEFT, KEY_RIGHT, KEY_PRIOR, KEY_NEXT, KEY_OTHER
+};
+#define MOD_SHIFT 0x1
+#define MOD_CTRL  0x4
+
+typedef enum { EV_NONE, EV_EXPOSE, EV_RESIZE, EV_KEY, EV_BUTTON, EV_QUIT } UiEventType;
+
+typedef struct {
+    UiEventType type;
+    int x, y, width, height;    // expose rect, new size, or pointer position
+    int key;                    // EV_KEY: character or KEY_*
+    unsigned mods;              // MOD_* mask
+    int button;                 // EV_BUTTON: 1-3 buttons, 4/5 wheel
+    char text[32];              // EV_KEY: text the key produces
+    int len;
+} UiEvent;
+
+typedef struct {
+    const char *name;
+    // Create the window and back buffer; reports font metrics. 0 on success.
+    int (*open)(int width, int height, int *ascent, int *descent);
+    void (*close)(void);
+    int (*conn_fd)(void);       // readable when input arrives, -1 if the backend has none
+    int (*wait_ms)(void);       // fd-less backends: ms until the next event is due, -1 if none
+    int (*pending)(void);
+    void (*next_event)(UiEvent *ev);
+    void (*resize)(int width, int height);
+    int (*text_width)(const char *s, int n);
+    // Drawing goes to the back buffer
+    void (*fill_rect)(int color, int x, int y, int w, int h);
+    void (*draw_rect)(int color, int x, int y, int w, int h);
+    void (*draw_line)(int color, int x0, int y0, int x1, int y1);
+    void (*draw_text)(int color, int x, int y, const char *s, int n);
+    void (*copy_area)(int sx, int sy, int w, int h, int dx, int dy);
+    // Copy a rectangle of the back buffer to the screen
+    void (*present)(int x, int y, int w, int h);
+} Backend;
+
+extern const Backend x11_backend;
+extern const Backend headless_backend;
+
+#endif // BACKEND_H
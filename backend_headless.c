@@ -0,0 +1,264 @@
+// Headless backend: renders into an in-memory 8-bit framebuffer and replays
+// input from a script, so the UI core runs without an X server.
+//
+// Script (MYTERM_SCRIPT=<file>), one command per line:
+//   type <text>          key events for each character of text
+//   key [ctrl+][shift+]<name>   Return, KP_Enter, Escape, BackSpace, Tab,
+//                        Left, Right, Prior/PageUp, Next/PageDown or a character
+//   click <x> <y> [button]
+//   resize <w> <h>
+//   expose
+//   wait <ms>            delay the following events
+//   quit                 stop once running jobs have finished (also at end of script)
+// MYTERM_HEADLESS_DUMP=<file> writes the final screen as a PGM image on exit.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "backend.h"
+
+#define GLYPH_W 6
+#define GLYPH_ASCENT 11
+#define GLYPH_DESCENT 2
+
+static unsigned char *back, *front;   // color indices, one byte per pixel
+static int fb_w, fb_h;
+
+static UiEvent *script;
+static long *script_at;               // due time of each event (ms since open)
+static int script_len, script_pos, script_cap;
+static struct timespec t_open;
+static unsigned long frames_presented;
+
+static long elapsed_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t_open.tv_sec) * 1000 + (now.tv_nsec - t_open.tv_nsec) / 1000000;
+}
+
+static void push_event(const UiEvent *ev, long at) {
+    if (script_len == script_cap) {
+        script_cap = script_cap ? script_cap * 2 : 64;
+        script = realloc(script, (size_t)script_cap * sizeof(*script));
+        script_at = realloc(script_at, (size_t)script_cap * sizeof(*script_at));
+        if (!script || !script_at) { perror("realloc"); exit(1); }
+    }
+    script[script_len] = *ev;
+    script_at[script_len] = at;
+    script_len++;
+}
+
+static int parse_key(const char *name, UiEvent *ev) {
+    static const struct { const char *name; int key; } keys[] = {
+        { "Return", KEY_RETURN }, { "KP_Enter", KEY_KP_ENTER }, { "Escape", KEY_ESCAPE },
+        { "BackSpace", KEY_BACKSPACE }, { "Tab", KEY_TAB }, { "Left", KEY_LEFT }, { "Right", KEY_RIGHT },
+        { "Prior", KEY_PRIOR }, { "PageUp", KEY_PRIOR }, { "Next", KEY_NEXT }, { "PageDown", KEY_NEXT },
+    };
+    for (;;) {
+        if (strncasecmp(name, "ctrl+", 5) == 0) { ev->mods |= MOD_CTRL; name += 5; }
+        else if (strncasecmp(name, "shift+", 6) == 0) { ev->mods |= MOD_SHIFT; name += 6; }
+        else break;
+    }
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strcmp(name, keys[i].name) == 0) {
+            ev->key = keys[i].key;
+            if (ev->key == KEY_RETURN || ev->key == KEY_KP_ENTER) { ev->text[0] = '\r'; ev->len = 1; }
+            if (ev->key == KEY_TAB) { ev->text[0] = '\t'; ev->len = 1; }
+            if (ev->key == KEY_BACKSPACE) { ev->text[0] = '\b'; ev->len = 1; }
+            return 0;
+        }
+    }
+    if (name[0] && !name[1]) {
+        unsigned char c = (unsigned char)name[0];
+        ev->key = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        ev->text[0] = (ev->mods & MOD_CTRL) ? (char)(c & 0x1f) : (char)c;
+        ev->len = 1;
+        return 0;
+    }
+    return -1;
+}
+
+static void load_script(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return; }
+    char line[4096];
+    long at = 0;
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        size_t n = strlen(line);
+        while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r')) line[--n] = '\0';
+        if (n == 0 || line[0] == '#') continue;
+        UiEvent ev;
+        memset(&ev, 0, sizeof(ev));
+        if (strncmp(line, "type ", 5) == 0) {
+            for (const char *p = line + 5; *p; p++) {
+                memset(&ev, 0, sizeof(ev));
+                ev.type = EV_KEY;
+                ev.key = (unsigned char)*p;
+                ev.text[0] = *p; ev.len = 1;
+                push_event(&ev, at);
+            }
+        } else if (strncmp(line, "key ", 4) == 0) {
+            ev.type = EV_KEY;
+            if (parse_key(line + 4, &ev) == 0) push_event(&ev, at);
+            else fprintf(stderr, "%s:%d: unknown key '%s'\n", path, lineno, line + 4);
+        } else if (sscanf(line, "click %d %d %d", &ev.x, &ev.y, &ev.button) >= 2) {
+            ev.type = EV_BUTTON;
+            if (!ev.button) ev.button = 1;
+            push_event(&ev, at);
+        } else if (sscanf(line, "resize %d %d", &ev.width, &ev.height) == 2) {
+            ev.type = EV_RESIZE;
+            push_event(&ev, at);
+        } else if (strcmp(line, "expose") == 0) {
+            ev.type = EV_EXPOSE;
+            ev.width = fb_w; ev.height = fb_h;
+            push_event(&ev, at);
+        } else if (strncmp(line, "wait ", 5) == 0) {
+            at += atol(line + 5);
+        } else if (strcmp(line, "quit") == 0) {
+            break;
+        } else {
+            fprintf(stderr, "%s:%d: unknown command '%s'\n", path, lineno, line);
+        }
+    }
+    fclose(f);
+    UiEvent quit;
+    memset(&quit, 0, sizeof(quit));
+    quit.type = EV_QUIT;
+    push_event(&quit, at);
+}
+
+static void hl_resize(int w, int h) {
+    free(back); free(front);
+    fb_w = w; fb_h = h;
+    back = calloc((size_t)w * (size_t)h, 1);
+    front = calloc((size_t)w * (size_t)h, 1);
+    if (!back || !front) { perror("calloc"); exit(1); }
+}
+
+static int hl_open(int width, int height, int *ascent, int *descent) {
+    clock_gettime(CLOCK_MONOTONIC, &t_open);
+    hl_resize(width, height);
+    *ascent = GLYPH_ASCENT; *descent = GLYPH_DESCENT;
+    const char *path = getenv("MYTERM_SCRIPT");
+    if (path && *path) {
+        load_script(path);
+    } else {
+        UiEvent quit;
+        memset(&quit, 0, sizeof(quit));
+        quit.type = EV_QUIT;
+        push_event(&quit, 0);
+    }
+    return 0;
+}
+
+static void hl_close(void) {
+    const char *dump = getenv("MYTERM_HEADLESS_DUMP");
+    if (dump && *dump) {
+        FILE *f = fopen(dump, "wb");
+        if (f) {
+            fprintf(f, "P5\n%d %d\n%d\n", fb_w, fb_h, COL_COUNT - 1);
+            fwrite(front, 1, (size_t)fb_w * (size_t)fb_h, f);
+            fclose(f);
+        }
+    }
+    fprintf(stderr, "headless: %lu frames presented in %ld ms\n", frames_presented, elapsed_ms());
+    free(back); free(front);
+    back = front = NULL;
+}
+
+static int hl_conn_fd(void) { return -1; }
+
+static int hl_wait_ms(void) {
+    if (script_pos >= script_len) return -1;
+    long d = script_at[script_pos] - elapsed_ms();
+    return d > 0 ? (int)d : 0;
+}
+
+static int hl_pending(void) {
+    return script_pos < script_len && script_at[script_pos] <= elapsed_ms();
+}
+
+static void hl_next_event(UiEvent *ev) {
+    if (script_pos < script_len) *ev = script[script_pos++];
+    else { memset(ev, 0, sizeof(*ev)); ev->type = EV_NONE; }
+}
+
+static int hl_text_width(const char *s, int n) { (void)s; return GLYPH_W * n; }
+
+// Clip a rectangle to the framebuffer; returns 0 if nothing is left
+static int clip(int *x, int *y, int *w, int *h) {
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > fb_w) *w = fb_w - *x;
+    if (*y + *h > fb_h) *h = fb_h - *y;
+    return *w > 0 && *h > 0;
+}
+
+static void hl_fill_rect(int color, int x, int y, int w, int h) {
+    if (!clip(&x, &y, &w, &h)) return;
+    for (int r = y; r < y + h; r++) memset(back + (size_t)r * fb_w + x, color, (size_t)w);
+}
+
+static void hl_draw_rect(int color, int x, int y, int w, int h) {
+    hl_fill_rect(color, x, y, w + 1, 1);
+    hl_fill_rect(color, x, y + h, w + 1, 1);
+    hl_fill_rect(color, x, y, 1, h + 1);
+    hl_fill_rect(color, x + w, y, 1, h + 1);
+}
+
+static void hl_draw_line(int color, int x0, int y0, int x1, int y1) {
+    int dx = abs(x1 - x0), dy = abs(y1 - y0);
+    int steps = dx > dy ? dx : dy;
+    for (int i = 0; i <= steps; i++) {
+        int x = steps ? x0 + (x1 - x0) * i / steps : x0;
+        int y = steps ? y0 + (y1 - y0) * i / steps : y0;
+        if (x >= 0 && x < fb_w && y >= 0 && y < fb_h) back[(size_t)y * fb_w + x] = (unsigned char)color;
+    }
+}
+
+// Glyphs are solid boxes: enough to exercise the per-glyph cost and to
+// make output visible in a dump
+static void hl_draw_text(int color, int x, int y, const char *s, int n) {
+    for (int i = 0; i < n; i++, x += GLYPH_W)
+        if (s[i] != ' ') hl_fill_rect(color, x + 1, y - GLYPH_ASCENT + 3, GLYPH_W - 2, GLYPH_ASCENT - 3);
+}
+
+static void hl_copy_area(int sx, int sy, int w, int h, int dx, int dy) {
+    if (!clip(&sx, &sy, &w, &h)) return;
+    if (dy + h > fb_h) h = fb_h - dy;
+    if (dx + w > fb_w) w = fb_w - dx;
+    if (w <= 0 || h <= 0 || dx < 0 || dy < 0) return;
+    if (dy <= sy) {
+        for (int r = 0; r < h; r++) memmove(back + (size_t)(dy + r) * fb_w + dx, back + (size_t)(sy + r) * fb_w + sx, (size_t)w);
+    } else {
+        for (int r = h - 1; r >= 0; r--) memmove(back + (size_t)(dy + r) * fb_w + dx, back + (size_t)(sy + r) * fb_w + sx, (size_t)w);
+    }
+}
+
+static void hl_present(int x, int y, int w, int h) {
+    frames_presented++;
+    if (!clip(&x, &y, &w, &h)) return;
+    for (int r = y; r < y + h; r++) memcpy(front + (size_t)r * fb_w + x, back + (size_t)r * fb_w + x, (size_t)w);
+}
+
+const Backend headless_backend = {
+    .name = "headless",
+    .open = hl_open,
+    .close = hl_close,
+    .conn_fd = hl_conn_fd,
+    .wait_ms = hl_wait_ms,
+    .pending = hl_pending,
+    .next_event = hl_next_event,
+    .resize = hl_resize,
+    .text_width = hl_text_width,
+    .fill_rect = hl_fill_rect,
+    .draw_rect = hl_draw_rect,
+    .draw_line = hl_draw_line,
+    .draw_text = hl_draw_text,
+    .copy_area = hl_copy_area,
+    .present = hl_present,
+};
@@ -0,0 +1,177 @@
+#define _XOPEN_SOURCE 700
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <string.h>
+#include "backend.h"
+
+static Display *dpy;
+static Window win;
+static Pixmap backbuf = None;   // off-screen frame, blitted to win by present()
+static GC gc;
+static int screen;
+static XFontStruct *fontinfo = NULL;
+static int win_width, win_height;
+static unsigned long pixels[COL_COUNT];
+static int cur_color = -1;      // avoids redundant XSetForeground round trips
+
+static void set_color(int color) {
+    if (color == cur_color) return;
+    XSetForeground(dpy, gc, pixels[color]);
+    cur_color = color;
+}
+
+static void x11_resize(int w, int h) {
+    if (backbuf != None) XFreePixmap(dpy, backbuf);
+    win_width = w; win_height = h;
+    backbuf = XCreatePixmap(dpy, win, (unsigned)w, (unsigned)h, (unsigned)DefaultDepth(dpy, screen));
+    set_color(COL_BG);
+    XFillRectangle(dpy, backbuf, gc, 0, 0, (unsigned)w, (unsigned)h);
+}
+
+static int x11_open(int width, int height, int *ascent, int *descent) {
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) return -1;
+    screen = DefaultScreen(dpy);
+    win = XCreateSimpleWindow(dpy, RootWindow(dpy, screen), 100, 100, (unsigned)width, (unsigned)height, 1,
+                              BlackPixel(dpy, screen), WhitePixel(dpy, screen));
+    XStoreName(dpy, win, "MyTerm");
+    XSelectInput(dpy, win, ExposureMask | KeyPressMask | ButtonPressMask | StructureNotifyMask);
+    XSetWindowBackgroundPixmap(dpy, win, None);  // the back buffer covers every pixel
+    XMapWindow(dpy, win);
+    gc = XCreateGC(dpy, win, 0, NULL);
+    XSetGraphicsExposures(dpy, gc, False);
+    // Colors
+    Colormap cmap = DefaultColormap(dpy, screen);
+    XColor scr, exact;
+    if (XAllocNamedColor(dpy, cmap, "#121212", &scr, &exact)) pixels[COL_BG] = scr.pixel; else pixels[COL_BG] = BlackPixel(dpy, screen);
+    if (XAllocNamedColor(dpy, cmap, "#E6EDF3", &scr, &exact)) pixels[COL_FG] = scr.pixel; else pixels[COL_FG] = WhitePixel(dpy, screen);
+    if (XAllocNamedColor(dpy, cmap, "#1F2937", &scr, &exact)) pixels[COL_TAB_ACTIVE] = scr.pixel; else pixels[COL_TAB_ACTIVE] = pixels[COL_BG];
+    if (XAllocNamedColor(dpy, cmap, "#0B0F14", &scr, &exact)) pixels[COL_TAB_INACTIVE] = scr.pixel; else pixels[COL_TAB_INACTIVE] = pixels[COL_BG];
+    if (XAllocNamedColor(dpy, cmap, "#10B981", &scr, &exact)) pixels[COL_ACCENT] = scr.pixel; else pixels[COL_ACCENT] = pixels[COL_FG];
+    static const char *ansi[16] = {
+        "#3B4252", "#E06C75", "#98C379", "#E5C07B", "#61AFEF", "#C678DD", "#56B6C2", "#D0D7DE",
+        "#6E7681", "#FF7B85", "#B5E890", "#FFD98A", "#82C4FF", "#DDA0F0", "#7FD6E0", "#FFFFFF",
+    };
+    for (int i = 0; i < 16; i++)
+        pixels[COL_ANSI + i] = XAllocNamedColor(dpy, cmap, ansi[i], &scr, &exact) ? scr.pixel : pixels[COL_FG];
+    // Load a fixed-width font for proper caret placement
+    fontinfo = XLoadQueryFont(dpy, "fixed");
+    if (fontinfo) {
+        XSetFont(dpy, gc, fontinfo->fid);
+        *ascent = fontinfo->ascent; *descent = fontinfo->descent;
+    } else {
+        *ascent = 12; *descent = 2;
+    }
+    x11_resize(width, height);
+    return 0;
+}
+
+static void x11_close(void) {
+    if (!dpy) return;
+    if (backbuf != None) XFreePixmap(dpy, backbuf);
+    XCloseDisplay(dpy);
+    dpy = NULL;
+}
+
+static int x11_conn_fd(void) { return ConnectionNumber(dpy); }
+static int x11_wait_ms(void) { return -1; }
+static int x11_pending(void) { return XPending(dpy); }
+
+static int map_keysym(KeySym ks) {
+    switch (ks) {
+    case XK_Return: return KEY_RETURN;
+    case XK_KP_Enter: return KEY_KP_ENTER;
+    case XK_Escape: return KEY_ESCAPE;
+    case XK_BackSpace: return KEY_BACKSPACE;
+    case XK_Tab: return KEY_TAB;
+    case XK_Left: return KEY_LEFT;
+    case XK_Right: return KEY_RIGHT;
+    case XK_Prior: return KEY_PRIOR;
+    case XK_Next: return KEY_NEXT;
+    }
+    if (ks >= XK_A && ks <= XK_Z) return (int)(ks - XK_A + 'a');
+    if (ks > 0 && ks < 0x80) return (int)ks;
+    return KEY_OTHER;
+}
+
+static void x11_next_event(UiEvent *out) {
+    XEvent ev;
+    XNextEvent(dpy, &ev);
+    memset(out, 0, sizeof(*out));
+    if (ev.type == Expose) {
+        out->type = EV_EXPOSE;
+        out->x = ev.xexpose.x; out->y = ev.xexpose.y;
+        out->width = ev.xexpose.width; out->height = ev.xexpose.height;
+    } else if (ev.type == ConfigureNotify) {
+        out->type = EV_RESIZE;
+        out->width = ev.xconfigure.width; out->height = ev.xconfigure.height;
+    } else if (ev.type == KeyPress) {
+        KeySym keysym;
+        out->type = EV_KEY;
+        out->len = XLookupString(&ev.xkey, out->text, sizeof(out->text) - 1, &keysym, NULL);
+        if (out->len < 0) out->len = 0;
+        out->key = map_keysym(keysym);
+        if (ev.xkey.state & ShiftMask) out->mods |= MOD_SHIFT;
+        if (ev.xkey.state & ControlMask) out->mods |= MOD_CTRL;
+    } else if (ev.type == ButtonPress) {
+        out->type = EV_BUTTON;
+        out->x = ev.xbutton.x; out->y = ev.xbutton.y;
+        out->button = (int)ev.xbutton.button;
+    } else {
+        out->type = EV_NONE;
+    }
+}
+
+static int x11_text_width(const char *s, int n) {
+    return fontinfo ? XTextWidth(fontinfo, s, n) : 8 * n;
+}
+
+static void x11_fill_rect(int color, int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) return;
+    set_color(color);
+    XFillRectangle(dpy, backbuf, gc, x, y, (unsigned)w, (unsigned)h);
+}
+
+static void x11_draw_rect(int color, int x, int y, int w, int h) {
+    set_color(color);
+    XDrawRectangle(dpy, backbuf, gc, x, y, (unsigned)w, (unsigned)h);
+}
+
+static void x11_draw_line(int color, int x0, int y0, int x1, int y1) {
+    set_color(color);
+    XDrawLine(dpy, backbuf, gc, x0, y0, x1, y1);
+}
+
+static void x11_draw_text(int color, int x, int y, const char *s, int n) {
+    set_color(color);
+    XDrawString(dpy, backbuf, gc, x, y, s, n);
+}
+
+static void x11_copy_area(int sx, int sy, int w, int h, int dx, int dy) {
+    if (w <= 0 || h <= 0) return;
+    XCopyArea(dpy, backbuf, backbuf, gc, sx, sy, (unsigned)w, (unsigned)h, dx, dy);
+}
+
+static void x11_present(int x, int y, int w, int h) {
+    if (w > 0 && h > 0) XCopyArea(dpy, backbuf, win, gc, x, y, (unsigned)w, (unsigned)h, x, y);
+    XFlush(dpy);
+}
+
+const Backend x11_backend = {
+    .name = "x11",
+    .open = x11_open,
+    .close = x11_close,
+    .conn_fd = x11_conn_fd,
+    .wait_ms = x11_wait_ms,
+    .pending = x11_pending,
+    .next_event = x11_next_event,
+    .resize = x11_resize,
+    .text_width = x11_text_width,
+    .fill_rect = x11_fill_rect,
+    .draw_rect = x11_draw_rect,
+    .draw_line = x11_draw_line,
+    .draw_text = x11_draw_text,
+    .copy_area = x11_copy_area,
+    .present = x11_present,
+};
@@ -0,0 +1,276 @@
+// Headless benchmark for the MyTerm core: drives the scrollback, line index,
+// renderer (on the headless backend), parser, pipeline launcher and history
+// search with synthetic workloads and prints the results as one JSON object.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "myterm.h"
+#include "scrollback.h"
+#include "vt.h"
+#include "exec.h"
+#include "parse.h"
+#include "history.h"
+#include "jobs.h"
+#include "main.h"
+
+#define SURF_COLS 120
+#define SURF_ROWS 40
+
+// The real UI core (main.c built without main()) runs on the headless
+// backend; ingest and line index numbers use a scrollback of their own.
+static Scrollback sb;
+
+// ---- helpers ----
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double pct(double *v, int n, double p) {
+    int i = (int)(p * (n - 1) + 0.5);
+    return v[i];
+}
+
+// Drain one pipeline's capture pipes and reap its stages, as the UI loop would
+static void drain_pipeline(Capture *c) {
+    while (c->out_fd != -1 || c->err_fd != -1) {
+        struct pollfd pfds[2]; int n = 0;
+        if (c->out_fd != -1) pfds[n++] = (struct pollfd){ .fd = c->out_fd, .events = POLLIN };
+        if (c->err_fd != -1) pfds[n++] = (struct pollfd){ .fd = c->err_fd, .events = POLLIN };
+        poll(pfds, (nfds_t)n, -1);
+        int *fds[2] = { &c->out_fd, &c->err_fd };
+        for (int k = 0; k < 2; k++) {
+            if (*fds[k] == -1) continue;
+            char buf[4096];
+            ssize_t r = read(*fds[k], buf, sizeof(buf));
+            if (r > 0) append_output(buf, (size_t)r);
+            else if (r == 0 || errno != EAGAIN) { close(*fds[k]); *fds[k] = -1; }
+        }
+    }
+    // the UI reaps from its signalfd; here a blocking wait feeds the same reaper
+    for (int i = 0; i < c->nstages; i++) {
+        int st;
+        pid_t pid;
+        while (c->pids[i] > 0 && (pid = waitpid(-1, &st, 0)) > 0) child_dispatch(pid, st);
+    }
+}
+
+// Run the bench capture's command line to the end
+static void wait_capture(void) {
+    Capture *c = current_capture();
+    if (!c->active) return;
+    do drain_pipeline(c); while (plan_continue(c));
+    c->active = 0; c->fg_child = -1;
+}
+
+// ---- workloads ----
+static void bench_ingest(size_t mb) {
+    static char chunk[64 * 1024];
+    for (size_t i = 0; i < sizeof(chunk); i++) chunk[i] = (i % 81 == 80) ? '\n' : (char)('a' + i % 26);
+    size_t total = mb << 20, done = 0;
+    double t0 = now_s();
+    while (done < total) { sb_append(&sb, chunk, sizeof(chunk)); done += sizeof(chunk); }
+    double t = now_s() - t0;
+    printf("  \"ingest\": {\"bytes\": %zu, \"seconds\": %.6f, \"bytes_per_sec\": %.0f},\n", done, t, (double)done / t);
+}
+
+// The same ingest through the VT filter: plain text, then text where every
+// line carries a few SGR colours (as from ls --color or gcc)
+static void bench_vt(size_t mb) {
+    static char plain[64 * 1024], ansi[64 * 1024];
+    static const char item[] = "\033[01;34mdir\033[0m  \033[01;32mexe\033[0m  file.c  ";
+    for (size_t i = 0; i < sizeof(plain); i++) plain[i] = (i % 81 == 80) ? '\n' : (char)('a' + i % 26);
+    for (size_t i = 0; i < sizeof(ansi); i++) ansi[i] = (i % 81 == 80) ? '\n' : item[i % 81 % (sizeof(item) - 1)];
+    const char *name[] = { "plain", "ansi" };
+    const char *chunk[] = { plain, ansi };
+    printf("  \"vt_ingest\": {");
+    for (int k = 0; k < 2; k++) {
+        Scrollback vsb;
+        Vt vt = {0};
+        sb_init(&vsb, SCROLLBACK_MAX_BYTES, SCROLLBACK_MAX_LINES);
+        size_t total = mb << 20, done = 0;
+        double t0 = now_s();
+        while (done < total) { vt_write(&vt, &vsb, chunk[k], sizeof(plain)); done += sizeof(plain); }
+        double t = now_s() - t0;
+        printf("%s\"%s_bytes_per_sec\": %.0f", k ? ", " : "", name[k], (double)done / t);
+        sb_free(&vsb);
+    }
+    printf("},\n");
+}
+
+static void bench_line_index(void) {
+    size_t total = sb_line_count(&sb);
+    int iters = 200000;
+    uint64_t sink = 0;
+    double t0 = now_s();
+    for (int i = 0; i < iters; i++) {
+        size_t line = (size_t)((uint64_t)i * 2654435761u % total);
+        uint64_t ls, le;
+        sb_line(&sb, line, &ls, &le);
+        sink += le - ls;
+    }
+    double t = now_s() - t0;
+    printf("  \"line_index\": {\"lines\": %zu, \"lookups\": %d, \"ns_per_lookup\": %.1f, \"checksum\": %llu},\n",
+           total, iters, t * 1e9 / iters, (unsigned long long)sink);
+}
+
+static void bench_render(void) {
+    static const char line[] = "drwxr-xr-x  2 user user  4096 Jan  1 00:00 some-directory-name\n";
+    int frames = 20000;
+    long lines = 0;
+    double t0 = now_s();
+    for (int f = 0; f < frames; f++) {
+        for (int k = 0; k < 8; k++) append_output(line, sizeof(line) - 1);
+        lines += 8;
+        ui_paint();
+    }
+    double t = now_s() - t0;
+    printf("  \"render\": {\"frames\": %d, \"lines\": %ld, \"lines_per_sec\": %.0f, \"frames_per_sec\": %.0f},\n",
+           frames, lines, (double)lines / t, frames / t);
+}
+
+static void bench_keypress(void) {
+    enum { N = 20000 };
+    static double lat[N];
+    for (int i = 0; i < N; i++) {
+        // type 128 characters, then erase them again
+        UiEvent ev = { .type = EV_KEY };
+        if (i % 256 < 128) { ev.key = 'a' + i % 26; ev.text[0] = (char)ev.key; ev.len = 1; }
+        else ev.key = KEY_BACKSPACE;
+        double t0 = now_s();
+        ui_handle_event(&ev);
+        ui_paint();
+        lat[i] = (now_s() - t0) * 1e6;
+    }
+    qsort(lat, N, sizeof(lat[0]), cmp_double);
+    printf("  \"keypress_to_paint_us\": {\"samples\": %d, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n",
+           N, pct(lat, N, 0.5), pct(lat, N, 0.9), pct(lat, N, 0.99), lat[N - 1]);
+}
+
+static void bench_parse(void) {
+    static const char *lines[] = {
+        "ls -la /usr/include",
+        "cat file.txt | grep pattern | sort | uniq -c | sort -rn",
+        "sort < input.txt > output.txt",
+        "echo \"hello world\" 'single quoted' >> log.txt",
+        "find . -name '*.c' | xargs wc -l | tail -1",
+    };
+    int iters = 200000, nl = (int)(sizeof(lines) / sizeof(lines[0]));
+    long argc_sum = 0;
+    double t0 = now_s();
+    for (int i = 0; i < iters; i++) {
+        Arena a = { 0 };
+        const char *err;
+        Node *list = parse_line(lines[i % nl], &a, &err);
+        for (int k = 0; list && k < list->n; k++) {
+            const Node *p = list->items[k].pipeline;
+            for (int s = 0; s < p->n; s++) argc_sum += p->stages[s]->n;
+        }
+        arena_free(&a);
+    }
+    double t = now_s() - t0;
+    // the same lines again through the plan cache, as re-runs from history do
+    double t1 = now_s();
+    for (int i = 0; i < iters; i++) {
+        const char *err;
+        Parsed *p = parse_cached(lines[i % nl], &err);
+        if (p) parse_release(p);
+    }
+    double tc = now_s() - t1;
+    printf("  \"parse\": {\"commands\": %d, \"ns_per_command\": %.1f, \"cached_ns_per_command\": %.1f, \"args\": %ld},\n",
+           iters, t * 1e9 / iters, tc * 1e9 / iters, argc_sum);
+}
+
+static void bench_spawn(const char *name, const char *cmd, int last) {
+    enum { N = 200 };
+    static double lat[N];
+    for (int i = 0; i < N; i++) {
+        char line[MAX_INPUT];
+        snprintf(line, sizeof(line), "%s", cmd);
+        double t0 = now_s();
+        execute_pipeline(line);
+        wait_capture();
+        lat[i] = (now_s() - t0) * 1e6;
+    }
+    qsort(lat, N, sizeof(lat[0]), cmp_double);
+    printf("    \"%s\": {\"runs\": %d, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f}%s\n",
+           name, N, pct(lat, N, 0.5), pct(lat, N, 0.9), pct(lat, N, 0.99), last ? "" : ",");
+}
+
+static void bench_history(void) {
+    static const char *words[] = { "git", "make", "grep", "ls", "cat", "ssh", "docker", "python3", "gcc", "vim" };
+    char line[256];
+    double t0 = now_s();
+    for (int i = 0; i < 10000; i++) {
+        snprintf(line, sizeof(line), "%s --flag-%d %s/path/to/file_%d.txt | %s -v pattern%d",
+                 words[i % 10], i % 97, words[(i / 10) % 10], i, words[(i / 100) % 10], i % 13);
+        add_history(line);
+    }
+    double t_add = now_s() - t0;
+    static const char *terms[] = { "grep --flag-42", "docker/path/to/file_9999.txt", "no-such-command-anywhere", "make", "xyz" };
+    int nt = (int)(sizeof(terms) / sizeof(terms[0]));
+    printf("  \"history\": {\"entries\": 10000, \"add_ms\": %.3f, \"search_ms\": {", t_add * 1e3);
+    for (int k = 0; k < nt; k++) {
+        double t1 = now_s();
+        history_search_and_print(terms[k]);
+        printf("\"%s\": %.3f%s", terms[k], (now_s() - t1) * 1e3, k + 1 < nt ? ", " : "");
+    }
+    // Ctrl+R as you type: one lookup per keystroke, refining from the last hit
+    double worst = 0;
+    for (int k = 0; k < nt; k++) {
+        char typed[256];
+        long pos = -1;
+        for (size_t n = 1; terms[k][n - 1]; n++) {
+            memcpy(typed, terms[k], n); typed[n] = '\0';
+            double t1 = now_s();
+            history_find(typed, &pos);
+            double d = now_s() - t1;
+            if (d > worst) worst = d;
+        }
+    }
+    printf("}, \"incremental_max_us\": %.2f}\n", worst * 1e6);
+}
+
+int main(int argc, char **argv) {
+    size_t mb = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 256;
+    sb_init(&sb, SCROLLBACK_MAX_BYTES, SCROLLBACK_MAX_LINES);
+    if (ui_open(&headless_backend) < 0) die("ui_open");
+    printf("{\n");
+    bench_ingest(mb);
+    bench_vt(mb);
+    bench_line_index();
+    bench_render();
+    bench_keypress();
+    bench_parse();
+    printf("  \"spawn_us\": {\n");
+    bench_spawn("true", "true", 0);                 // builtin, in-process
+    bench_spawn("exec_true", "/bin/true", 0);       // spawn + exec
+    bench_spawn("pipeline_4", "true | true | true | true", 0);
+    char p16[MAX_INPUT] = "/bin/true";
+    for (int i = 1; i < 16; i++) strcat(p16, " | /bin/true");
+    bench_spawn("pipeline_16", p16, 0);
+    // launch cost must not grow with the UI's resident memory
+    size_t ballast_len = (size_t)512 << 20;
+    char *ballast = malloc(ballast_len);
+    if (ballast) memset(ballast, 1, ballast_len);
+    bench_spawn("pipeline_16_rss512m", p16, 1);
+    free(ballast);
+    printf("  },\n");
+    bench_history();
+    printf("}\n");
+    return 0;
+}
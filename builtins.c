@@ -0,0 +1,394 @@
+// In-process builtins. Dispatch is a small hash table keyed by command name;
+// single commands run inside the UI process with no fork, pipeline stages run
+// in the forked child without exec.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include "myterm.h"
+#include "history.h"
+#include "trace.h"
+#include "jobs.h"
+#include "builtins.h"
+
+void builtin_out(BuiltinIO *io, const char *s, size_t n) {
+    if (io->out == -1) { append_output(s, n); return; }
+    while (n > 0) {
+        ssize_t w = write(io->out, s, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        s += w; n -= (size_t)w;
+    }
+}
+
+void builtin_err(BuiltinIO *io, const char *s, size_t n) {
+    BuiltinIO e = { .in = io->in, .out = io->err, .err = io->err, .ui = io->ui };
+    builtin_out(&e, s, n);
+}
+
+static void out_str(BuiltinIO *io, const char *s) { builtin_out(io, s, strlen(s)); }
+
+static void err_msg(BuiltinIO *io, const char *cmd, const char *what, int err) {
+    char msg[512];
+    int n = snprintf(msg, sizeof(msg), "%s: %s: %s\n", cmd, what, strerror(err));
+    builtin_err(io, msg, n < (int)sizeof(msg) ? (size_t)n : sizeof(msg) - 1);
+}
+
+static int bi_cd(int argc, char **argv, BuiltinIO *io) {
+    const char *path = argc > 1 ? argv[1] : getenv("HOME");
+    if (!path) path = ".";
+    if (chdir(path) != 0) { out_str(io, "cd: failed\n"); return 1; }
+    return 0;
+}
+
+static int bi_history(int argc, char **argv, BuiltinIO *io) {
+    (void)argc; (void)argv;
+    print_history_command(io);
+    return 0;
+}
+
+static int bi_timing(int argc, char **argv, BuiltinIO *io) {
+    (void)argc; (void)argv;
+    print_timing_command(io);
+    return 0;
+}
+
+static int bi_clear(int argc, char **argv, BuiltinIO *io) {
+    (void)argc; (void)argv;
+    // only meaningful for the tab itself, not inside a pipeline
+    if (io->out == -1) clear_screen();
+    return 0;
+}
+
+static int bi_help(int argc, char **argv, BuiltinIO *io) {
+    (void)argc; (void)argv;
+    out_str(io, "\n");
+    out_str(io, "MyTerm\n");
+    out_str(io, "=================================\n\n");
+    out_str(io, "Built-in Commands:\n");
+    out_str(io, "  cd [dir]          Change directory\n");
+    out_str(io, "  clear             Clear the screen\n");
+    out_str(io, "  history           Show command history\n");
+    out_str(io, "  jobs              Show background and stopped jobs\n");
+    out_str(io, "  fg [%n], bg [%n]  Resume a job in the tab / in the background\n");
+    out_str(io, "  kill [-SIG] %n    Signal a job's processes\n");
+    out_str(io, "  timing            Show launch latency of recent commands\n");
+    out_str(io, "  help              Show this help message\n");
+    out_str(io, "  multiWatch [...]  Run commands in parallel\n");
+    out_str(io, "  echo, printf, pwd, cat, true, false\n");
+    out_str(io, "                    Run inside MyTerm without starting a process\n");
+    out_str(io, "\n");
+    out_str(io, "I/O Redirection:\n");
+    out_str(io, "  cmd < file        Redirect input from file\n");
+    out_str(io, "  cmd > file        Redirect output to file (overwrite)\n");
+    out_str(io, "  cmd >> file       Redirect output to file (append)\n");
+    out_str(io, "  cmd 2> file       Redirect errors (2>> appends, 2>&1 joins output)\n");
+    out_str(io, "  cmd <<< text      Feed text as input\n");
+    out_str(io, "  cmd1 | cmd2       Pipe output to next command\n");
+    out_str(io, "  a && b, a || b    Run b if a succeeded / failed\n");
+    out_str(io, "  a; b              Run a, then b\n");
+    out_str(io, "  (a; b)            Run a list in a subshell\n");
+    out_str(io, "  cmd &             Run command in background\n");
+    out_str(io, "\n");
+    out_str(io, "Keyboard Shortcuts:\n");
+    out_str(io, "  Ctrl+A            Move cursor to line start\n");
+    out_str(io, "  Ctrl+E            Move cursor to line end\n");
+    out_str(io, "  Ctrl+C            Interrupt running command\n");
+    out_str(io, "  Ctrl+Z            Stop command (resume with fg or bg)\n");
+    out_str(io, "  Ctrl+R            Search command history\n");
+    out_str(io, "  Ctrl+T            Create new tab\n");
+    out_str(io, "  Tab               Auto-complete filename\n");
+    out_str(io, "  Shift+Enter       Insert newline (multiline input)\n");
+    out_str(io, "  PageUp/PageDown   Scroll output\n");
+    out_str(io, "\n");
+    out_str(io, "Examples:\n");
+    out_str(io, "  ls -la | grep txt\n");
+    out_str(io, "  sort < input.txt > output.txt\n");
+    out_str(io, "  gcc -o prog prog.c && ./prog\n");
+    out_str(io, "  multiWatch [\"cmd1\", \"cmd2\"]\n");
+    out_str(io, "\n");
+    return 0;
+}
+
+static int bi_jobs(int argc, char **argv, BuiltinIO *io) {
+    (void)argc; (void)argv;
+    Capture *cap = current_capture();
+    int shown = 0;
+    if (cap->active && cap->fg_child > 0) {
+        char msg[200];
+        snprintf(msg, sizeof(msg), "[fg]  %-22s %s (pid %d)\n", "Running", cap->command, cap->fg_child);
+        out_str(io, msg);
+        shown++;
+    }
+    shown += print_jobs_command(io);
+    if (shown == 0) out_str(io, "No jobs running\n");
+    return 0;
+}
+
+// Job named by argv[1] (the current job if absent); -1 after reporting
+static int job_arg(int argc, char **argv, BuiltinIO *io) {
+    int id = job_find(argc > 1 ? argv[1] : NULL);
+    if (id < 0) {
+        char msg[300];
+        int n = snprintf(msg, sizeof(msg), "%s: %s: no such job\n", argv[0], argc > 1 ? argv[1] : "current");
+        builtin_err(io, msg, n < (int)sizeof(msg) ? (size_t)n : sizeof(msg) - 1);
+    }
+    return id;
+}
+
+static int bi_fg(int argc, char **argv, BuiltinIO *io) {
+    int id = job_arg(argc, argv, io);
+    if (id < 0) return 1;
+    Capture *cap = current_capture();
+    if (cap->active) {
+        const char *msg = "fg: the tab is busy\n";
+        builtin_err(io, msg, strlen(msg));
+        return 1;
+    }
+    return job_foreground(id, cap);
+}
+
+static int bi_bg(int argc, char **argv, BuiltinIO *io) {
+    int id = job_arg(argc, argv, io);
+    if (id < 0) return 1;
+    if (job_background(id, io) < 0) {
+        const char *msg = "bg: job has terminated\n";
+        builtin_err(io, msg, strlen(msg));
+        return 1;
+    }
+    return 0;
+}
+
+static const struct { const char *name; int sig; } signames[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "TERM", SIGTERM }, { "CONT", SIGCONT },
+    { "STOP", SIGSTOP }, { "TSTP", SIGTSTP },
+};
+
+// "9", "KILL" or "SIGKILL"; -1 if unknown
+static int parse_signal(const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (*s && !*end) return n > 0 && n < NSIG ? (int)n : -1;
+    if (strncmp(s, "SIG", 3) == 0) s += 3;
+    for (size_t i = 0; i < sizeof(signames) / sizeof(signames[0]); i++)
+        if (strcmp(s, signames[i].name) == 0) return signames[i].sig;
+    return -1;
+}
+
+// kill [-SIG | -s SIG] %job | pid ...
+static int bi_kill(int argc, char **argv, BuiltinIO *io) {
+    int sig = SIGTERM, i = 1;
+    if (i < argc && strcmp(argv[i], "-s") == 0 && i + 1 < argc) { sig = parse_signal(argv[i + 1]); i += 2; }
+    else if (i < argc && argv[i][0] == '-' && argv[i][1]) { sig = parse_signal(argv[i] + 1); i++; }
+    // anything else (-l, unknown names) is for the real kill
+    if (sig < 0) return BUILTIN_EXEC;
+    if (i == argc) {
+        const char *usage = "kill: usage: kill [-s sigspec | -sigspec] pid | %job ...\n";
+        builtin_err(io, usage, strlen(usage));
+        return 2;
+    }
+    int status = 0;
+    for (; i < argc; i++) {
+        int rc;
+        if (argv[i][0] == '%') {
+            int id = job_find(argv[i]);
+            if (id < 0) { rc = -1; errno = ESRCH; }
+            else rc = job_signal(id, sig);
+        } else {
+            char *end;
+            long pid = strtol(argv[i], &end, 10);
+            if (!argv[i][0] || *end) { rc = -1; errno = EINVAL; }
+            else rc = kill((pid_t)pid, sig);
+        }
+        if (rc < 0) { err_msg(io, "kill", argv[i], errno); status = 1; }
+    }
+    return status;
+}
+
+static int bi_true(int argc, char **argv, BuiltinIO *io) { (void)argc; (void)argv; (void)io; return 0; }
+static int bi_false(int argc, char **argv, BuiltinIO *io) { (void)argc; (void)argv; (void)io; return 1; }
+
+static int bi_pwd(int argc, char **argv, BuiltinIO *io) {
+    (void)argc; (void)argv;
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) { err_msg(io, "pwd", ".", errno); return 1; }
+    out_str(io, cwd);
+    out_str(io, "\n");
+    return 0;
+}
+
+static int bi_echo(int argc, char **argv, BuiltinIO *io) {
+    int i = 1, newline = 1;
+    if (i < argc && strcmp(argv[i], "-n") == 0) { newline = 0; i++; }
+    // the arguments came from one input line, so they fit
+    char buf[MAX_INPUT + 1];
+    size_t n = 0;
+    for (; i < argc; i++) {
+        size_t l = strlen(argv[i]);
+        memcpy(buf + n, argv[i], l); n += l;
+        if (i + 1 < argc) buf[n++] = ' ';
+    }
+    if (newline) buf[n++] = '\n';
+    builtin_out(io, buf, n);
+    return 0;
+}
+
+// Largest file cat prints without starting a process
+#ifndef CAT_INLINE_MAX
+#define CAT_INLINE_MAX (256 * 1024)
+#endif
+
+// Copy fd to the builtin's output
+static int copy_fd(BuiltinIO *io, int fd, const char *name) {
+    char buf[64 * 1024];
+    for (;;) {
+        ssize_t r = read(fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { err_msg(io, "cat", name, errno); return 1; }
+        if (r == 0) return 0;
+        builtin_out(io, buf, (size_t)r);
+    }
+}
+
+// What the UI process may read itself: a small regular file. A pipe, tty
+// or device could block or never end.
+static int cat_inline(const struct stat *st) {
+    return S_ISREG(st->st_mode) && st->st_size <= CAT_INLINE_MAX;
+}
+
+static int bi_cat(int argc, char **argv, BuiltinIO *io) {
+    // options, or stdin that only the real cat can wait on from the UI process
+    if (argc == 1 && io->in == -1) return BUILTIN_EXEC;
+    int reads_in = argc == 1;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && (argv[i][1] || io->in == -1)) return BUILTIN_EXEC;
+        if (strcmp(argv[i], "-") == 0) { reads_in = 1; continue; }
+        // in the UI process only small regular files, wherever the output
+        // goes; anything else could block or never end
+        struct stat st;
+        if (io->ui && stat(argv[i], &st) == 0 && !cat_inline(&st)) return BUILTIN_EXEC;
+    }
+    // a redirected stdin is held to the same rule
+    struct stat st;
+    if (io->ui && reads_in && (fstat(io->in, &st) < 0 || !cat_inline(&st))) return BUILTIN_EXEC;
+    if (argc == 1) return copy_fd(io, io->in, "-");
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        int fd = strcmp(argv[i], "-") == 0 ? io->in : open(argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { err_msg(io, "cat", argv[i], errno); status = 1; continue; }
+        status |= copy_fd(io, fd, argv[i]);
+        if (fd != io->in) close(fd);
+    }
+    return status;
+}
+
+// printf FORMAT [ARG]...: %s %d %i %u %x %c %% and backslash escapes; the
+// format is reused while arguments remain, as POSIX printf does
+static int bi_printf(int argc, char **argv, BuiltinIO *io) {
+    if (argc < 2) {
+        const char *usage = "printf: usage: printf format [arguments]\n";
+        builtin_err(io, usage, strlen(usage));
+        return 2;
+    }
+    const char *fmt = argv[1];
+    int ai = 2;
+    char out[4096];
+    size_t n = 0;
+#define PUT(s, l) do { size_t l_ = (l); if (n + l_ > sizeof(out)) { builtin_out(io, out, n); n = 0; } \
+                       if (l_ > sizeof(out)) builtin_out(io, (s), l_); else { memcpy(out + n, (s), l_); n += l_; } } while (0)
+    do {
+        int used = 0;
+        for (const char *p = fmt; *p; p++) {
+            if (*p == '\\' && p[1]) {
+                char c;
+                switch (*++p) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '\\': c = '\\'; break;
+                case 'a': c = '\a'; break;
+                default: PUT(p - 1, 1); c = *p; break;
+                }
+                PUT(&c, 1);
+            } else if (*p == '%' && p[1]) {
+                const char *arg = ai < argc ? argv[ai] : NULL;
+                char num[32];
+                switch (*++p) {
+                case '%': PUT("%", 1); break;
+                case 's': if (arg) { PUT(arg, strlen(arg)); ai++; } used = 1; break;
+                case 'c': if (arg) { PUT(arg, arg[0] ? 1 : 0); ai++; } used = 1; break;
+                case 'd': case 'i': case 'u': case 'x': {
+                    long long v = arg ? strtoll(arg, NULL, 0) : 0;
+                    int l = snprintf(num, sizeof(num), *p == 'x' ? "%llx" : *p == 'u' ? "%llu" : "%lld", v);
+                    PUT(num, (size_t)l);
+                    if (arg) ai++;
+                    used = 1;
+                    break;
+                }
+                default: PUT(p - 1, 2); break;
+                }
+            } else {
+                PUT(p, 1);
+            }
+        }
+        if (!used) break;
+    } while (ai < argc);
+#undef PUT
+    builtin_out(io, out, n);
+    return 0;
+}
+
+static const Builtin builtins[] = {
+    { "cd", bi_cd },
+    { "history", bi_history },
+    { "clear", bi_clear },
+    { "help", bi_help },
+    { "jobs", bi_jobs },
+    { "fg", bi_fg },
+    { "bg", bi_bg },
+    { "kill", bi_kill },
+    { "timing", bi_timing },
+    { "true", bi_true },
+    { "false", bi_false },
+    { "pwd", bi_pwd },
+    { "echo", bi_echo },
+    { "cat", bi_cat },
+    { "printf", bi_printf },
+};
+#define NBUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+// Open-addressed table of indexes into builtins[], built on first lookup
+#define BUILTIN_SLOTS 64
+static signed char slots[BUILTIN_SLOTS];
+static int slots_ready = 0;
+
+static uint32_t fnv1a(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h;
+}
+
+const Builtin *builtin_find(const char *name) {
+    if (!name) return NULL;
+    if (!slots_ready) {
+        memset(slots, -1, sizeof(slots));
+        for (size_t i = 0; i < NBUILTINS; i++) {
+            uint32_t h = fnv1a(builtins[i].name) & (BUILTIN_SLOTS - 1);
+            while (slots[h] != -1) h = (h + 1) & (BUILTIN_SLOTS - 1);
+            slots[h] = (signed char)i;
+        }
+        slots_ready = 1;
+    }
+    for (uint32_t h = fnv1a(name) & (BUILTIN_SLOTS - 1); slots[h] != -1; h = (h + 1) & (BUILTIN_SLOTS - 1))
+        if (strcmp(builtins[slots[h]].name, name) == 0) return &builtins[slots[h]];
+    return NULL;
+}
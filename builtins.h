@@ -0,0 +1,32 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+
+// Where a builtin reads and writes. -1 for out/err means the tab's output
+// (in-process run); in a pipeline child they are plain fds.
+typedef struct {
+    int in;
+    int out;
+    int err;
+    int ui;     // running in the UI process: nothing may block or run long
+} BuiltinIO;
+
+// Returns the exit status, or BUILTIN_EXEC to run the external program of
+// the same name instead (e.g. cat with no file and nothing to read)
+#define BUILTIN_EXEC (-1)
+typedef int (*BuiltinFn)(int argc, char **argv, BuiltinIO *io);
+
+typedef struct {
+    const char *name;
+    BuiltinFn fn;
+} Builtin;
+
+// Hashed lookup; NULL if name is not a builtin
+const Builtin *builtin_find(const char *name);
+
+// Write to the builtin's stdout / stderr
+void builtin_out(BuiltinIO *io, const char *s, size_t n);
+void builtin_err(BuiltinIO *io, const char *s, size_t n);
+
+#endif // BUILTINS_H
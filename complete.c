@@ -0,0 +1,271 @@
+// Tab completion engine: sorted per-directory name caches, scanned by a
+// worker thread so large directories never stall the UI.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "myterm.h"
+#include "complete.h"
+
+#ifndef COMPLETE_CACHE_DIRS
+#define COMPLETE_CACHE_DIRS 64
+#endif
+
+// One scanned directory. Names are NUL-separated in blob and sorted in
+// names; directories carry a trailing '/'. Only the UI thread touches these.
+typedef struct {
+    char *path;             // absolute; NULL = free slot
+    int exec_only;          // $PATH scan: executables only
+    int ready, loading;
+    struct timespec mtime;  // directory mtime when scanned
+    char *blob;
+    const char **names;
+    int count;
+    unsigned long used;     // LRU clock
+} DirCache;
+
+// A scan request, filled in by the worker and handed back whole
+typedef struct ScanJob {
+    struct ScanJob *next;
+    char *path;
+    int exec_only;
+    struct timespec mtime;
+    char *blob;
+    const char **names;
+    int count;
+} ScanJob;
+
+static DirCache cache[COMPLETE_CACHE_DIRS];
+static unsigned long clock_now;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static ScanJob *todo, *done;
+static int notify_fd[2] = { -1, -1 };
+
+static int cmp_name(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Worker side: read the whole directory into a sorted name list
+static void scan(ScanJob *job) {
+    // the mtime is taken even if the directory cannot be read: the empty
+    // listing then stays cached until it changes instead of being retried
+    struct stat st;
+    if (stat(job->path, &st) == 0) job->mtime = st.st_mtim;
+    DIR *d = opendir(job->path);
+    if (!d) return;
+    int dfd = dirfd(d);
+    if (fstat(dfd, &st) == 0) job->mtime = st.st_mtim;
+    size_t len = 0, cap = 4096, *offs = NULL, noffs = 0, offs_cap = 0;
+    char *blob = malloc(cap);
+    if (!blob) die("malloc");
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        const char *n = de->d_name;
+        if (strcmp(n, ".") == 0 || strcmp(n, "..") == 0) continue;
+        int is_dir = de->d_type == DT_DIR;
+        if (de->d_type == DT_UNKNOWN || de->d_type == DT_LNK)
+            is_dir = fstatat(dfd, n, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        if (job->exec_only && (is_dir || faccessat(dfd, n, X_OK, 0) != 0)) continue;
+        size_t nl = strlen(n) + (is_dir && !job->exec_only);
+        if (len + nl + 1 > cap) {
+            while (len + nl + 1 > cap) cap *= 2;
+            blob = realloc(blob, cap);
+            if (!blob) die("realloc");
+        }
+        memcpy(blob + len, n, strlen(n));
+        if (is_dir && !job->exec_only) blob[len + nl - 1] = '/';
+        blob[len + nl] = '\0';
+        if (noffs == offs_cap) {
+            offs_cap = offs_cap ? offs_cap * 2 : 256;
+            offs = realloc(offs, offs_cap * sizeof(*offs));
+            if (!offs) die("realloc");
+        }
+        offs[noffs++] = len;
+        len += nl + 1;
+    }
+    closedir(d);
+    job->names = malloc((noffs ? noffs : 1) * sizeof(*job->names));
+    if (!job->names) die("malloc");
+    for (size_t i = 0; i < noffs; i++) job->names[i] = blob + offs[i];
+    qsort(job->names, noffs, sizeof(*job->names), cmp_name);
+    job->blob = blob;
+    job->count = (int)noffs;
+    free(offs);
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (!todo) pthread_cond_wait(&wake, &lock);
+        ScanJob *job = todo;
+        todo = job->next;
+        pthread_mutex_unlock(&lock);
+
+        scan(job);
+
+        pthread_mutex_lock(&lock);
+        job->next = done;
+        done = job;
+        pthread_mutex_unlock(&lock);
+        ssize_t w = write(notify_fd[1], "", 1);   // pipe full is fine: a wakeup is pending
+        (void)w;
+    }
+    return NULL;
+}
+
+static void free_job(ScanJob *job) {
+    free(job->path);
+    free(job->blob);
+    free((void *)job->names);
+    free(job);
+}
+
+static DirCache *slot_for(const char *path, int exec_only) {
+    DirCache *lru = NULL;
+    for (int i = 0; i < COMPLETE_CACHE_DIRS; i++) {
+        DirCache *c = &cache[i];
+        if (c->path && c->exec_only == exec_only && strcmp(c->path, path) == 0) return c;
+        if (!c->loading && (!lru || !c->path || (lru->path && c->used < lru->used))) lru = c;
+    }
+    if (!lru) return NULL;
+    free(lru->path);
+    free(lru->blob);
+    free((void *)lru->names);
+    memset(lru, 0, sizeof(*lru));
+    lru->path = strdup(path);
+    if (!lru->path) die("strdup");
+    lru->exec_only = exec_only;
+    return lru;
+}
+
+// Cached listing of path if it is current, NULL while a scan is running.
+// A missing directory yields an empty listing.
+static const DirCache *lookup(const char *path, int exec_only) {
+    static const DirCache empty;
+    struct stat st;
+    if (notify_fd[0] == -1 || stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) return &empty;
+    DirCache *c = slot_for(path, exec_only);
+    if (!c) return &empty;
+    c->used = ++clock_now;
+    if (c->loading) return NULL;
+    if (c->ready && c->mtime.tv_sec == st.st_mtim.tv_sec && c->mtime.tv_nsec == st.st_mtim.tv_nsec) return c;
+    // new or changed since the last scan
+    ScanJob *job = calloc(1, sizeof(*job));
+    if (!job) die("calloc");
+    job->path = strdup(path);
+    if (!job->path) die("strdup");
+    job->exec_only = exec_only;
+    c->loading = 1;
+    pthread_mutex_lock(&lock);
+    job->next = todo;
+    todo = job;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// Append the names in c starting with prefix (binary search for the first)
+static int collect(const DirCache *c, const char *prefix, const char **out, int n, int max) {
+    size_t plen = strlen(prefix);
+    int lo = 0, hi = c->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(c->names[mid], prefix) < 0) lo = mid + 1; else hi = mid;
+    }
+    for (int i = lo; i < c->count && n < max && strncmp(c->names[i], prefix, plen) == 0; i++) out[n++] = c->names[i];
+    return n;
+}
+
+int complete_find(const char *dir, const char *prefix, const char **out, int max) {
+    char path[PATH_MAX];
+    if (dir) {
+        char cwd[PATH_MAX];
+        if (dir[0] == '/') snprintf(path, sizeof(path), "%s", dir);
+        else if (!getcwd(cwd, sizeof(cwd))) return 0;
+        else if (strcmp(dir, ".") == 0) snprintf(path, sizeof(path), "%s", cwd);
+        else if (snprintf(path, sizeof(path), "%s/%s", cwd, dir) >= (int)sizeof(path)) return 0;
+        const DirCache *c = lookup(path, 0);
+        return c ? collect(c, prefix, out, 0, max) : -1;
+    }
+    // commands: merge the listings of every $PATH directory
+    const char *p = getenv("PATH");
+    if (!p) p = "/usr/local/bin:/usr/bin:/bin";
+    static const char *merged[4 * COMPLETE_MAX];
+    int n = 0, pending = 0;
+    while (*p) {
+        const char *e = strchr(p, ':');
+        size_t l = e ? (size_t)(e - p) : strlen(p);
+        if (l == 0) snprintf(path, sizeof(path), ".");
+        else snprintf(path, sizeof(path), "%.*s", (int)l, p);
+        const DirCache *c = lookup(path, 1);
+        if (!c) pending = 1;
+        else n = collect(c, prefix, merged, n, (int)(sizeof(merged) / sizeof(merged[0])));
+        p += l + (e != NULL);
+    }
+    if (pending) return -1;
+    qsort(merged, (size_t)n, sizeof(merged[0]), cmp_name);
+    int k = 0;
+    for (int i = 0; i < n && k < max; i++)
+        if (k == 0 || strcmp(out[k - 1], merged[i]) != 0) out[k++] = merged[i];
+    return k;
+}
+
+int complete_fd(void) {
+    return notify_fd[0];
+}
+
+int complete_poll(void) {
+    char buf[64];
+    while (read(notify_fd[0], buf, sizeof(buf)) > 0) {}
+    pthread_mutex_lock(&lock);
+    ScanJob *list = done;
+    done = NULL;
+    pthread_mutex_unlock(&lock);
+    int any = 0;
+    while (list) {
+        ScanJob *job = list;
+        list = job->next;
+        DirCache *c = NULL;
+        for (int i = 0; i < COMPLETE_CACHE_DIRS; i++)
+            if (cache[i].loading && cache[i].exec_only == job->exec_only && strcmp(cache[i].path, job->path) == 0) c = &cache[i];
+        if (c) {
+            free(c->blob);
+            free((void *)c->names);
+            c->blob = job->blob;
+            c->names = job->names;
+            c->count = job->count;
+            c->mtime = job->mtime;
+            c->loading = 0;
+            c->ready = 1;
+            job->blob = NULL;
+            job->names = NULL;
+            any = 1;
+        }
+        free_job(job);
+    }
+    return any;
+}
+
+void complete_init(void) {
+    if (notify_fd[0] != -1) return;
+    if (pipe2(notify_fd, O_NONBLOCK | O_CLOEXEC) < 0) { notify_fd[0] = notify_fd[1] = -1; return; }
+    // the thread inherits the caller's signal mask (SIGCHLD stays blocked)
+    pthread_t th;
+    if (pthread_create(&th, NULL, worker, NULL) != 0) {
+        close(notify_fd[0]); close(notify_fd[1]);
+        notify_fd[0] = notify_fd[1] = -1;
+        return;
+    }
+    pthread_detach(th);
+    const char *out[1];
+    complete_find(NULL, "", out, 0);   // warm the $PATH caches
+}
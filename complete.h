@@ -0,0 +1,23 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+
+// Most matches a single lookup reports
+#define COMPLETE_MAX 512
+
+// Start the scanner thread and pre-scan the $PATH directories.
+void complete_init(void);
+
+// Names in dir (NULL = executables on $PATH) starting with prefix, sorted;
+// directory names end in '/'. Fills up to max pointers that stay valid until
+// the next complete_* call and returns the number of matches, or -1 while a
+// directory is still being scanned; complete_poll() reports when it is done.
+int complete_find(const char *dir, const char *prefix, const char **out, int max);
+
+// Readable when a scan has finished; -1 before complete_init()
+int complete_fd(void);
+// Install finished scans; returns 1 if any arrived
+int complete_poll(void);
+
+#endif // COMPLETE_H
@@ -1,262 +1,468 @@
+// F_SETPIPE_SZ and memfd_create are Linux-specific
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <poll.h>
 #include "myterm.h"
 #include "exec.h"
+#include "parse.h"
+#include "builtins.h"
+#include "jobs.h"
 
-static int is_whitespace(char c) { return c==' '||c=='\t' || c=='\n'; }
+#ifndef CAPTURE_PIPE_SIZE
+#define CAPTURE_PIPE_SIZE (1024 * 1024)
+#endif
+// Files one command may have open for its redirections
+#define MAX_REDIRS 16
 
-static char *trim(char *s) {
-    while (*s && is_whitespace(*s)) s++;
-    size_t len = strlen(s);
-    while (len>0 && is_whitespace(s[len-1])) { s[--len] = '\0'; }
-    return s;
+extern char **environ;
+
+static int in_child;    // forked stage: errors go to stderr, not the tab
+
+int exit_status(int wstatus) {
+    if (WIFEXITED(wstatus)) return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+    return 1;
 }
 
-int parse_args(char *cmd, char *argv[], char **infile, char **outfile, int *append) {
-    int argc = 0; *infile = NULL; *outfile = NULL; *append = 0;
-    char *p = cmd;
-    while (*p) {
-        while (is_whitespace(*p)) p++;
-        if (!*p) break;
-        if (*p == '"' || *p == '\'') {
-            char quote = *p++;
-            argv[argc++] = p;
-            while (*p && *p != quote) p++;
-            if (*p) *p++ = '\0';
-        } else if (*p == '<') {
-            p++;
-            while (is_whitespace(*p)) p++;
-            *infile = p;
-            while (*p && !is_whitespace(*p)) p++;
-            if (*p) *p++ = '\0';
-        } else if (*p == '>') {
-            p++;
-            if (*p == '>') { *append = 1; p++; }
-            while (is_whitespace(*p)) p++;
-            *outfile = p;
-            while (*p && !is_whitespace(*p)) p++;
-            if (*p) *p++ = '\0';
-        } else {
-            argv[argc++] = p;
-            while (*p && !is_whitespace(*p) && *p!='<' && *p!='>') p++;
-            if (*p) { *p++ = '\0'; }
-        }
-        if (argc >= MAX_ARGS-1) break;
+static void report_error(const char *what, int err) {
+    char msg[300];
+    int n = snprintf(msg, sizeof(msg), "myterm: %s: %s\n", what, strerror(err));
+    if (n >= (int)sizeof(msg)) n = sizeof(msg) - 1;
+    if (!in_child) { append_output(msg, (size_t)n); return; }
+    ssize_t w = write(STDERR_FILENO, msg, (size_t)n);
+    (void)w;
+}
+
+// `<<< word`: the text plus a newline in an anonymous file
+static int here_string(const char *s) {
+    int fd = memfd_create("myterm-herestring", MFD_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t n = strlen(s);
+    if (write(fd, s, n) != (ssize_t)n || write(fd, "\n", 1) != 1 || lseek(fd, 0, SEEK_SET) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
     }
-    argv[argc] = NULL;
-    return argc;
+    return fd;
 }
 
-int split_pipes(char *line, char *stages[]) {
-    int n = 0; char *p = line; stages[n++] = p;
-    while (*p) {
-        if (*p == '|') { *p = '\0'; if (n < MAX_PIPE) stages[n++] = p + 1; }
-        p++;
+// Opening a FIFO (or a device that waits) blocks until the other end shows
+// up, so the UI process leaves anything that is not a regular file to a
+// child. Missing files are fine: `>` creates them and `<` fails at once.
+static int redirs_block(const Redir *r) {
+    struct stat st;
+    for (; r; r = r->next)
+        if ((r->kind == REDIR_IN || r->kind == REDIR_OUT || r->kind == REDIR_APPEND) &&
+            stat(r->word, &st) == 0 && !S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode) && !S_ISCHR(st.st_mode)) return 1;
+    return 0;
+}
+
+// Apply redirections in order to fds[0..2] (-1 = the default). Files are
+// opened close-on-exec and listed in opened[]. Returns -1 after reporting
+// a failure. In the UI process only for redirs_block() == 0.
+static int apply_redirs(const Redir *r, int fds[3], int opened[MAX_REDIRS], int *nopened) {
+    for (; r; r = r->next) {
+        if (r->kind == REDIR_DUP) { fds[r->fd] = fds[r->dup_fd]; continue; }
+        if (*nopened == MAX_REDIRS) { report_error(r->word, EMFILE); return -1; }
+        int fd;
+        if (r->kind == REDIR_IN) fd = open(r->word, O_RDONLY | O_CLOEXEC);
+        else if (r->kind == REDIR_HERESTR) fd = here_string(r->word);
+        else fd = open(r->word, O_WRONLY | O_CREAT | O_CLOEXEC | (r->kind == REDIR_APPEND ? O_APPEND : O_TRUNC), 0644);
+        if (fd < 0) { report_error(r->kind == REDIR_HERESTR ? "<<<" : r->word, errno); return -1; }
+        opened[(*nopened)++] = fd;
+        fds[r->fd] = fd;
     }
-    return n;
+    return 0;
 }
 
-int execute_pipeline(char *line, int background) {
-    // support built-in 'cd' and 'history' when no pipe
-    char tmp[MAX_INPUT]; strncpy(tmp, line, sizeof(tmp)-1); tmp[sizeof(tmp)-1]='\0';
-    char *trimmed = trim(tmp);
-    // single built-ins
-    if (!strchr(trimmed, '|')) {
-        if (strncmp(trimmed, "cd ", 3) == 0 || strcmp(trimmed, "cd") == 0) {
-            const char *path = trimmed[2] ? trimmed + 3 : getenv("HOME");
-            if (!path) path = ".";
-            if (chdir(path) != 0) append_output_str("cd: failed\n");
-            return 0;
-        }
-        if (strcmp(trimmed, "history") == 0) {
-            extern void print_history_command(void);
-            print_history_command();
-            return 0;
-        }
-        if (strcmp(trimmed, "clear") == 0) {
-            // Clear the output buffer of current tab
-            extern void clear_screen(void);
-            clear_screen();
-            return 0;
-        }
-        if (strcmp(trimmed, "help") == 0) {
-            append_output_str("\n");
-            append_output_str("MyTerm\n");
-            append_output_str("=================================\n\n");
-            append_output_str("Built-in Commands:\n");
-            append_output_str("  cd [dir]          Change directory\n");
-            append_output_str("  clear             Clear the screen\n");
-            append_output_str("  history           Show command history\n");
-            append_output_str("  jobs              Show background jobs\n");
-            append_output_str("  help              Show this help message\n");
-            append_output_str("  multiWatch [...]  Run commands in parallel\n");
-            append_output_str("\n");
-            append_output_str("I/O Redirection:\n");
-            append_output_str("  cmd < file        Redirect input from file\n");
-            append_output_str("  cmd > file        Redirect output to file (overwrite)\n");
-            append_output_str("  cmd >> file       Redirect output to file (append)\n");
-            append_output_str("  cmd1 | cmd2       Pipe output to next command\n");
-            append_output_str("  cmd &             Run command in background\n");
-            append_output_str("\n");
-            append_output_str("Keyboard Shortcuts:\n");
-            append_output_str("  Ctrl+A            Move cursor to line start\n");
-            append_output_str("  Ctrl+E            Move cursor to line end\n");
-            append_output_str("  Ctrl+C            Interrupt running command\n");
-            append_output_str("  Ctrl+Z            Move command to background\n");
-            append_output_str("  Ctrl+R            Search command history\n");
-            append_output_str("  Ctrl+T            Create new tab\n");
-            append_output_str("  Tab               Auto-complete filename\n");
-            append_output_str("  Shift+Enter       Insert newline (multiline input)\n");
-            append_output_str("  PageUp/PageDown   Scroll output\n");
-            append_output_str("\n");
-            append_output_str("Examples:\n");
-            append_output_str("  ls -la | grep txt\n");
-            append_output_str("  sort < input.txt > output.txt\n");
-            append_output_str("  gcc -o prog prog.c && ./prog\n");
-            append_output_str("  multiWatch [\"cmd1\", \"cmd2\"]\n");
-            append_output_str("\n");
-            return 0;
+static void close_all(int *fds, int n) {
+    for (int i = 0; i < n; i++) close(fds[i]);
+}
+
+// Run builtin b (NULL: a command that is only redirections) in this
+// process. defaults are its stdin/stdout/stderr before redirection; -1
+// means the tab. Returns its status or BUILTIN_EXEC, also when a redirection
+// could block the UI and the command has to run in a child.
+static int run_builtin(const Builtin *b, const Node *cmd, const int defaults[3], Timeline *tl) {
+    if (!in_child && redirs_block(cmd->redirs)) return BUILTIN_EXEC;
+    int fds[3] = { defaults[0], defaults[1], defaults[2] };
+    int opened[MAX_REDIRS], nopened = 0;
+    if (apply_redirs(cmd->redirs, fds, opened, &nopened) < 0) { close_all(opened, nopened); return 1; }
+    int status = 0;
+    if (b) {
+        BuiltinIO io = { .in = fds[0], .out = fds[1], .err = fds[2], .ui = !in_child };
+        trace_mark(tl, TRACE_SPAWNED);
+        status = b->fn(cmd->n, cmd->argv, &io);
+        // whatever it printed is in the scrollback already
+        if (status != BUILTIN_EXEC) trace_mark(tl, TRACE_FIRST_BYTE);
+    }
+    close_all(opened, nopened);
+    return status;
+}
+
+// spawn_process() plus the command's redirections, applied in order by the
+// child as file actions: the UI never opens the files itself, so a FIFO
+// without a writer blocks only the child. Here-strings are memfds made here.
+static int spawn_redirected(pid_t *pid, char *const argv[], const int fds[3], const Redir *redirs, pid_t pgid) {
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    int opened[MAX_REDIRS], nopened = 0;
+    posix_spawn_file_actions_init(&fa);
+    for (int k = 0; k < 3; k++) if (fds[k] != -1) posix_spawn_file_actions_adddup2(&fa, fds[k], k);
+    for (const Redir *r = redirs; r; r = r->next) {
+        if (r->kind == REDIR_DUP) { posix_spawn_file_actions_adddup2(&fa, r->dup_fd, r->fd); continue; }
+        if (r->kind == REDIR_IN) { posix_spawn_file_actions_addopen(&fa, r->fd, r->word, O_RDONLY, 0); continue; }
+        if (r->kind != REDIR_HERESTR) {
+            int flags = O_WRONLY | O_CREAT | (r->kind == REDIR_APPEND ? O_APPEND : O_TRUNC);
+            posix_spawn_file_actions_addopen(&fa, r->fd, r->word, flags, 0644);
+            continue;
         }
-        if (strcmp(trimmed, "jobs") == 0) {
-            extern int cap_active;
-            extern pid_t fg_child;
-            extern BackgroundJob bg_jobs[];
-            extern int bg_job_count;
-            
-            int shown = 0;
-            
-            // Show foreground job if active
-            if (cap_active && fg_child > 0) {
-                char msg[128];
-                snprintf(msg, sizeof(msg), "[fg]  Running                 (pid %d)\n", fg_child);
-                append_output_str(msg);
-                shown++;
-            }
-            
-            // Show background jobs and check their status
-            for (int i = 0; i < MAX_JOBS; i++) {
-                if (bg_jobs[i].active) {
-                    // Check if process still exists
-                    int alive = 0;
-                    for (int j = 0; j < bg_jobs[i].nprocs; j++) {
-                        if (bg_jobs[i].pids[j] > 0) {
-                            int status;
-                            pid_t result = waitpid(bg_jobs[i].pids[j], &status, WNOHANG);
-                            if (result == 0) {
-                                alive = 1;  // Still running
-                            } else if (result == bg_jobs[i].pids[j]) {
-                                bg_jobs[i].pids[j] = 0;  // Process finished
-                            }
-                        }
-                    }
-                    
-                    if (alive) {
-                        char msg[256];
-                        snprintf(msg, sizeof(msg), "[%d]  Running                 %s\n", 
-                                i + 1, bg_jobs[i].command);
-                        append_output_str(msg);
-                        shown++;
-                    } else {
-                        // All processes done, mark job as inactive
-                        bg_jobs[i].active = 0;
-                        bg_job_count--;
-                    }
-                }
-            }
-            
-            if (shown == 0) {
-                append_output_str("No jobs running\n");
-            }
-            return 0;
+        int fd = nopened < MAX_REDIRS ? here_string(r->word) : (errno = EMFILE, -1);
+        if (fd < 0) {
+            int e = errno;
+            close_all(opened, nopened);
+            posix_spawn_file_actions_destroy(&fa);
+            report_error("<<<", e);
+            return -1;
         }
+        opened[nopened++] = fd;
+        posix_spawn_file_actions_adddup2(&fa, fd, r->fd);
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 34)
+    // everything the UI owns is O_CLOEXEC already; this catches the rest
+    posix_spawn_file_actions_addclosefrom_np(&fa, STDERR_FILENO + 1);
+#endif
+    // the UI blocks SIGCHLD for its signalfd; children start unblocked
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    if (pgid >= 0) { posix_spawnattr_setpgroup(&attr, pgid); flags |= POSIX_SPAWN_SETPGROUP; }
+    posix_spawnattr_setflags(&attr, flags);
+    int rc = posix_spawnp(pid, argv[0], &fa, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    close_all(opened, nopened);
+    return rc;
+}
+
+int spawn_process(pid_t *pid, char *const argv[], int in, int out, int err, pid_t pgid) {
+    int fds[3] = { in, out, err };
+    return spawn_redirected(pid, argv, fds, NULL, pgid);
+}
+
+// posix_spawn does not say which file action failed: name the first
+// redirection that cannot be opened, else the command itself
+static const char *spawn_culprit(const Node *s) {
+    for (const Redir *r = s->redirs; r; r = r->next) {
+        if (r->kind == REDIR_IN && access(r->word, R_OK) < 0) return r->word;
+        if ((r->kind != REDIR_OUT && r->kind != REDIR_APPEND) || access(r->word, W_OK) == 0) continue;
+        if (errno != ENOENT) return r->word;
+        // a new file: its directory must be there and writable
+        const char *slash = strrchr(r->word, '/');
+        char dir[4096];
+        snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - r->word) + 1 : 1, slash ? r->word : ".");
+        if (access(dir, W_OK | X_OK) < 0) return r->word;
     }
+    return NULL;
+}
+
+// Put fds[k] on fd k; each source is first moved above 2, so `2>&1 1>f`
+// style orders cannot overwrite a source before it is used
+static void install_fds(const int fds[3]) {
+    int tmp[3];
+    for (int k = 0; k < 3; k++) tmp[k] = fds[k] != -1 && fds[k] != k ? fcntl(fds[k], F_DUPFD_CLOEXEC, STDERR_FILENO + 1) : -1;
+    for (int k = 0; k < 3; k++) if (tmp[k] != -1) { dup2(tmp[k], k); close(tmp[k]); }
+}
 
-    // build pipeline
-    char *stages[MAX_PIPE];
-    int nstages = split_pipes(line, stages);
-    int pipes_fd[MAX_PIPE-1][2];
-    for (int i=0;i<nstages-1;i++) if (pipe(pipes_fd[i])<0) die("pipe");
-
-    // determine if parent should capture stdout from last stage (no explicit outfile), and always capture stderr
-    int out_pipe[2] = {-1,-1};
-    int err_pipe[2] = {-1,-1};
-    {
-        char lastbuf[MAX_INPUT]; strncpy(lastbuf, trim(stages[nstages-1]), sizeof(lastbuf)-1); lastbuf[sizeof(lastbuf)-1]='\0';
-        char *infile=NULL,*outfile=NULL; int app=0; char *argv_dummy[MAX_ARGS];
-        parse_args(lastbuf, argv_dummy, &infile, &outfile, &app);
-        if (outfile == NULL) {
-            if (pipe(out_pipe) < 0) die("pipe");
+// Child side of a fork: move fds onto stdin/stdout/stderr and drop the
+// rest, or readers downstream never see EOF
+static void child_setup(const int fds[3]) {
+    in_child = 1;
+    reset_child_signals();
+    jobs_forget();
+    install_fds(fds);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 34)
+    if (close_range(STDERR_FILENO + 1, ~0U, 0) == 0) return;
+#endif
+    // no close_range (old kernel or libc): close up to the fd limit
+    long max = sysconf(_SC_OPEN_MAX);
+    for (int fd = STDERR_FILENO + 1; fd < (max > 0 && max < 65536 ? max : 65536); fd++) close(fd);
+}
+
+static int run_list_sync(const Node *list);
+
+// Builtin pipeline stage, subshell, bare redirection or a program with a
+// redirection that may block: these need a process of their own before the
+// program (if any) starts, so they are the only stages that fork. Their
+// redirections are opened in the child.
+static pid_t fork_stage(const Builtin *b, const Node *s, const int fds[3], pid_t pgid) {
+    pid_t pid = fork();
+    // both sides set the group so it exists before either one goes on
+    if (pid > 0 && pgid >= 0) setpgid(pid, pgid);
+    if (pid != 0) return pid;
+    if (pgid >= 0) setpgid(0, pgid);
+    child_setup(fds);
+    // redirections go onto 0-2 here, so a builtin that falls back to the
+    // program passes them on through exec
+    int std[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    int opened[MAX_REDIRS], nopened = 0;
+    if (apply_redirs(s->redirs, std, opened, &nopened) < 0) _exit(1);
+    install_fds(std);
+    close_all(opened, nopened);
+    if (s->type == NODE_SUBSHELL) _exit(run_list_sync(s->body));
+    if (!b && s->n == 0) _exit(0);
+    int status = BUILTIN_EXEC;
+    if (b) {
+        BuiltinIO io = { .in = STDIN_FILENO, .out = STDOUT_FILENO, .err = STDERR_FILENO };
+        status = b->fn(s->n, s->argv, &io);
+    }
+    if (status != BUILTIN_EXEC) _exit(status);
+    execvp(s->argv[0], s->argv);
+    report_error(s->argv[0], errno);
+    _exit(127);
+}
+
+// Start every stage of pipeline p; in, out and err are the pipeline's outer
+// fds (-1 = inherit). Fills pids, 0 for a stage that did not start, and
+// returns the exit status of the last stage if it did not start, else -1.
+// With pgid the stages join process group *pgid, or a new one led by the
+// first stage if it is 0; NULL keeps them in ours.
+static int launch(const Node *p, int in, int out, int err, pid_t *pids, pid_t *pgid) {
+    int prev = -1, status = -1;
+    for (int i = 0; i < p->n; i++) {
+        const Node *s = p->stages[i];
+        int pfd[2] = { -1, -1 };
+        if (i < p->n - 1 && pipe2(pfd, O_CLOEXEC) < 0) die("pipe");
+        int fds[3] = { i > 0 ? prev : in, i < p->n - 1 ? pfd[1] : out, err };
+        pids[i] = 0;
+        status = -1;
+        const Builtin *b = s->type == NODE_CMD ? s->builtin : NULL;
+        // posix_spawn waits for the child to exec, so an open that can block
+        // has to happen in a forked child
+        if (b || s->type == NODE_SUBSHELL || s->n == 0 || redirs_block(s->redirs)) {
+            if ((pids[i] = fork_stage(b, s, fds, pgid ? *pgid : -1)) < 0) die("fork");
+        } else {
+            int rc = spawn_redirected(&pids[i], s->argv, fds, s->redirs, pgid ? *pgid : -1);
+            if (rc > 0) {
+                const char *bad = spawn_culprit(s);
+                report_error(bad ? bad : s->argv[0], rc);
+                status = bad ? 1 : rc == ENOENT ? 127 : 126;
+            }
+            if (rc != 0) pids[i] = 0;
+            if (rc < 0) status = 1;
         }
-        if (pipe(err_pipe) < 0) die("pipe");
+        if (pgid && !*pgid && pids[i] > 0) *pgid = pids[i];
+        if (prev != -1) close(prev);
+        if (pfd[1] != -1) close(pfd[1]);
+        prev = pfd[0];
     }
+    return status;
+}
 
+static int item_runs(int op, int status) {
+    return op == LIST_SEQ || (op == LIST_AND) == (status == 0);
+}
+
+// Subshell body: run the list to completion inside the forked child
+static int run_pipeline_sync(const Node *p) {
+    static const int std[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    const Node *s = p->stages[0];
+    if (p->n == 1 && s->type == NODE_CMD && (s->builtin || s->n == 0)) {
+        int status = run_builtin(s->builtin, s, std, NULL);
+        if (status != BUILTIN_EXEC) return status;
+    }
     pid_t pids[MAX_PIPE];
-    for (int i=0;i<nstages;i++) {
-        char *infile=NULL,*outfile=NULL; int app=0; char *argv[MAX_ARGS];
-        char stagebuf[MAX_INPUT];
-        strncpy(stagebuf, trim(stages[i]), sizeof(stagebuf)-1); stagebuf[sizeof(stagebuf)-1]='\0';
-        parse_args(stagebuf, argv, &infile, &outfile, &app);
-        pid_t pid = fork();
-        if (pid<0) die("fork");
-        if (pid==0) {
-            // child
-            // set up stdin/stdout
-            if (i>0) { dup2(pipes_fd[i-1][0], STDIN_FILENO); }
-            if (i<nstages-1) { dup2(pipes_fd[i][1], STDOUT_FILENO); }
-            // close all pipe fds
-            for (int k=0;k<nstages-1;k++){ close(pipes_fd[k][0]); close(pipes_fd[k][1]); }
-            // redirections
-            if (infile) {
-                int fd = open(infile, O_RDONLY);
-                if (fd<0) _exit(127);
-                dup2(fd, STDIN_FILENO); close(fd);
-            }
-            if (outfile) {
-                int flags = O_WRONLY|O_CREAT|(app?O_APPEND:O_TRUNC);
-                int fd = open(outfile, flags, 0644);
-                if (fd<0) _exit(127);
-                dup2(fd, STDOUT_FILENO); close(fd);
-            } else if (i == nstages-1 && out_pipe[1] != -1) {
-                // last stage: capture stdout to parent
-                dup2(out_pipe[1], STDOUT_FILENO);
-            }
-            // always capture stderr of last stage
-            if (i == nstages-1 && err_pipe[1] != -1) {
-                dup2(err_pipe[1], STDERR_FILENO);
-            }
-            if (out_pipe[0] != -1) close(out_pipe[0]);
-            if (out_pipe[1] != -1) close(out_pipe[1]);
-            if (err_pipe[0] != -1) close(err_pipe[0]);
-            if (err_pipe[1] != -1) close(err_pipe[1]);
-            execvp(argv[0], argv);
-            // exec failed: write error to stderr (captured by parent if enabled)
-            fprintf(stderr, "myterm: %s: %s\n", argv[0] ? argv[0] : "(null)", strerror(errno));
-            _exit(127);
+    int status = launch(p, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, pids, NULL);
+    for (int i = 0; i < p->n; i++) {
+        if (pids[i] <= 0) continue;
+        int w;
+        while (waitpid(pids[i], &w, 0) < 0 && errno == EINTR) {}
+        if (i == p->n - 1) status = exit_status(w);
+    }
+    return status < 0 ? 0 : status;
+}
+
+static int run_list_sync(const Node *list) {
+    int status = 0;
+    for (int i = 0; i < list->n; i++) {
+        const ListItem *it = &list->items[i];
+        if (!item_runs(it->op, status)) continue;
+        if (!it->background) { status = run_pipeline_sync(it->pipeline); continue; }
+        // '&' in a subshell: started and left to finish on its own
+        pid_t pids[MAX_PIPE];
+        launch(it->pipeline, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, pids, NULL);
+        status = 0;
+    }
+    return status;
+}
+
+static size_t put_str(char *buf, size_t n, size_t len, const char *s) {
+    while (*s && len + 1 < n) buf[len++] = *s++;
+    buf[len] = '\0';
+    return len;
+}
+
+// Text of pipeline p for job listings: words and stages, no redirections
+static void describe(const Node *p, char *buf, size_t n) {
+    size_t len = put_str(buf, n, 0, "");
+    for (int i = 0; i < p->n; i++) {
+        const Node *s = p->stages[i];
+        if (i > 0) len = put_str(buf, n, len, " | ");
+        if (s->type == NODE_SUBSHELL) { len = put_str(buf, n, len, "( ... )"); continue; }
+        for (int k = 0; k < s->n; k++) {
+            if (k > 0) len = put_str(buf, n, len, " ");
+            len = put_str(buf, n, len, s->argv[k]);
         }
-        pids[i] = pid;
     }
-    // parent closes all pipeline intermediate fds
-    for (int k=0;k<nstages-1;k++){ close(pipes_fd[k][0]); close(pipes_fd[k][1]); }
-    // close write ends of capture pipes in parent, keep read ends and make them nonblocking
-    if (out_pipe[1] != -1) close(out_pipe[1]);
-    if (err_pipe[1] != -1) close(err_pipe[1]);
-    if (out_pipe[0] != -1) { int fl = fcntl(out_pipe[0], F_GETFL, 0); fcntl(out_pipe[0], F_SETFL, fl | O_NONBLOCK); }
-    if (err_pipe[0] != -1) { int fl = fcntl(err_pipe[0], F_GETFL, 0); fcntl(err_pipe[0], F_SETFL, fl | O_NONBLOCK); }
+}
+
+// Capture pipes: stdout of the last stage and stderr of every stage; the
+// read ends are nonblocking for the main loop
+static void capture_pipes(int out_pipe[2], int err_pipe[2]) {
+    if (pipe2(out_pipe, O_CLOEXEC) < 0 || pipe2(err_pipe, O_CLOEXEC) < 0) die("pipe");
+    fcntl(out_pipe[0], F_SETFL, fcntl(out_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(err_pipe[0], F_SETFL, fcntl(err_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+    // a larger pipe lets fast producers run longer between UI wakeups
+    fcntl(out_pipe[0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+#endif
+}
+
+// Start pipeline p in capture c. Returns -1 once processes are running (the
+// plan resumes in plan_continue()), or the status of a builtin that ran
+// in-process.
+static int start_pipeline(Capture *c, const Node *p) {
+    static const int tab[3] = { -1, -1, -1 };
+    const Node *s = p->stages[0];
+    // a lone builtin runs in-process: no fork, no capture pipes
+    if (p->n == 1 && s->type == NODE_CMD && (s->builtin || s->n == 0)) {
+        int status = run_builtin(s->builtin, s, tab, &c->tl);
+        if (status != BUILTIN_EXEC) return status;
+    }
+    int out_pipe[2], err_pipe[2];
+    capture_pipes(out_pipe, err_pipe);
+    c->pgid = 0;
+    int status = launch(p, -1, out_pipe[1], err_pipe[1], c->pids, &c->pgid);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
 
     // register capture state and return immediately; main loop will pump IO
-    cap_out_fd = out_pipe[0];
-    cap_err_fd = err_pipe[0];
-    for (int i=0;i<nstages;i++) cap_pids[i] = pids[i];
-    cap_nstages = nstages;
-    cap_active = 1;
-    fg_child = pids[nstages-1];
-    (void)background;
+    c->out_fd = out_pipe[0];
+    c->err_fd = err_pipe[0];
+    c->nstages = p->n;
+    c->active = 1;
+    c->fg_child = c->pids[p->n - 1];
+    c->status = status < 0 ? 0 : status;
+    describe(p, c->command, sizeof(c->command));
+    capture_watch(c);
+    trace_mark(&c->tl, TRACE_SPAWNED);
+    return -1;
+}
+
+// An item ended by '&': a job of its own, read into its buffer by the main
+// loop while the line goes on. Returns the status the next item sees.
+static int start_background(Capture *c, const Node *p) {
+    if (jobs_full()) { append_output_str("myterm: too many jobs\n"); return 1; }
+    int out_pipe[2], err_pipe[2];
+    capture_pipes(out_pipe, err_pipe);
+    pid_t pids[MAX_PIPE], pgid = 0;
+    launch(p, -1, out_pipe[1], err_pipe[1], pids, &pgid);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    if (!pgid) {
+        // nothing started and the errors are on the tab already
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        return 0;
+    }
+    char command[sizeof(c->command)];
+    describe(p, command, sizeof(command));
+    int id = job_add(c, pids, p->n, pgid, out_pipe[0], err_pipe[0], command);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "[%d] %d\n", id, (int)pgid);
+    append_output_str(msg);
+    trace_mark(&c->tl, TRACE_SPAWNED);
+    return 0;
+}
+
+// Run list items until one has to wait for processes; returns 1 if a
+// pipeline is running, 0 once the plan is finished
+static int plan_step(Capture *c) {
+    Plan *pl = &c->plan;
+    const Node *list = pl->parsed->list;
+    while (pl->next < list->n) {
+        const ListItem *it = &list->items[pl->next++];
+        if (!item_runs(it->op, pl->status)) continue;
+        if (it->background) { pl->status = start_background(c, it->pipeline); continue; }
+        int status = start_pipeline(c, it->pipeline);
+        // processes to wait for, or a job `fg` brought into the tab
+        if (status < 0 || c->active) return 1;
+        pl->status = status;
+    }
+    plan_abort(c);
+    return 0;
+}
+
+int plan_continue(Capture *c) {
+    c->active = 0;
+    if (!c->plan.parsed) return 0;
+    c->plan.status = c->status;
+    return plan_step(c);
+}
+
+void plan_abort(Capture *c) {
+    if (!c->plan.parsed) return;
+    parse_release(c->plan.parsed);
+    c->plan.parsed = NULL;
+}
+
+int execute_pipeline(char *line) {
+    Capture *c = current_capture();
+    const char *err = NULL;
+    Parsed *parsed = parse_cached(line, &err);
+    if (!c->active) trace_mark(&c->tl, TRACE_PARSED);
+    if (!parsed) {
+        char msg[200];
+        snprintf(msg, sizeof(msg), "myterm: %s\n", err);
+        append_output_str(msg);
+        return -1;
+    }
+    const Node *list = parsed->list;
+
+    // one foreground job per tab; a lone builtin may still run beside it
+    if (c->active) {
+        static const int tab[3] = { -1, -1, -1 };
+        const Node *p = list->n == 1 ? list->items[0].pipeline : NULL;
+        const Node *s = p && p->n == 1 && p->stages[0]->type == NODE_CMD ? p->stages[0] : NULL;
+        int status = s && s->builtin ? run_builtin(s->builtin, s, tab, NULL) : BUILTIN_EXEC;
+        parse_release(parsed);
+        if (status != BUILTIN_EXEC) return 0;
+        append_output_str("myterm: a command is already running in this tab\n");
+        return -1;
+    }
+
+    c->plan = (Plan){ .parsed = parsed, .next = 0, .status = 0 };
+    c->status = 0;
+    if (!plan_step(c)) {
+        // everything ran in-process
+        trace_mark(&c->tl, TRACE_EXIT);
+        trace_settle(&c->tl);
+    }
     return 0;
 }
@@ -3,8 +3,21 @@
 
 #include "myterm.h"
 
-int parse_args(char *cmd, char *argv[], char **infile, char **outfile, int *append);
-int split_pipes(char *line, char *stages[]);
-int execute_pipeline(char *line, int background);
+// Parse a command line and start running it in the current tab's capture:
+// builtins run in-process, each pipeline is left running and the next one
+// starts from plan_continue(); items ended by '&' become jobs (jobs.c)
+int execute_pipeline(char *line);
+// The capture's pipeline has exited and c->status holds its status: run the
+// rest of the line. Returns 1 if a pipeline is running again, 0 when done.
+int plan_continue(Capture *c);
+// Drop what is left of the line (Ctrl+C, Ctrl+Z, tab closed)
+void plan_abort(Capture *c);
+// Shell-style status of a waitpid() result (128 + signal when killed)
+int exit_status(int wstatus);
+// posix_spawn argv (PATH lookup) with stdin/stdout/stderr dup'd from
+// in/out/err (-1 = inherit) and an empty signal mask; other fds are closed.
+// pgid >= 0 puts it in that process group (0: a new one led by itself).
+// Returns 0 or the errno of the failed spawn, exec included.
+int spawn_process(pid_t *pid, char *const argv[], int in, int out, int err, pid_t pgid);
 
 #endif // EXEC_H
@@ -1,27 +1,165 @@
-// Enable POSIX functions (getline, strdup) on glibc
-#ifndef _POSIX_C_SOURCE
-#define _POSIX_C_SOURCE 200809L
-#endif
+// Enable memmem and memrchr on glibc
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "history.h"
+#include "builtins.h"
 #include "myterm.h"
 
 #ifndef HISTORY_MAX
 #define HISTORY_MAX 10000
 #endif
 
-static char *history[HISTORY_MAX];
-static size_t history_count = 0;
+// Bytes of command text kept in memory; oldest entries are dropped when
+// either this or HISTORY_MAX is reached
+#ifndef HISTORY_ARENA_SIZE
+#define HISTORY_ARENA_SIZE (2u * 1024 * 1024)
+#endif
+
+// Entries live in a ring indexed by sequence number (slot = seq % HISTORY_MAX);
+// their text is stored NUL-terminated and contiguous in a circular arena.
+// Offsets are absolute, so live text is [entries[first_seq].off, arena_end).
+typedef struct {
+    uint64_t off;
+    uint32_t len;
+} HistEntry;
+
+static HistEntry entries[HISTORY_MAX];
+static char arena[HISTORY_ARENA_SIZE];
+static uint64_t arena_end = 0;
 static char history_path[512];
 
+// Live entries are first_seq .. next_seq - 1
+static uint32_t first_seq = 0, next_seq = 0;
+
+// Trigram index: for each 3-byte substring, the ascending list of sequence
+// numbers of entries containing it. Evicted entries form a prefix of every
+// list and are skipped by advancing head.
+typedef struct {
+    uint32_t *seqs;
+    uint32_t head, len, cap;
+} Posting;
+
+static uint32_t *tri_keys;      // open addressing; 0 = empty slot
+static Posting *tri_lists;
+static size_t tri_cap, tri_used;
+
+#define TRI_KEY(s) ((1u << 24) | ((uint32_t)(unsigned char)(s)[0] << 16) | \
+                    ((uint32_t)(unsigned char)(s)[1] << 8) | (uint32_t)(unsigned char)(s)[2])
+
+static size_t tri_slot(uint32_t key) {
+    size_t i = (key * 2654435761u) & (tri_cap - 1);
+    while (tri_keys[i] && tri_keys[i] != key) i = (i + 1) & (tri_cap - 1);
+    return i;
+}
+
+static void posting_prune(Posting *p) {
+    while (p->head < p->len && p->seqs[p->head] < first_seq) p->head++;
+    if (p->head > 0 && p->head * 2 >= p->len) {
+        memmove(p->seqs, p->seqs + p->head, (p->len - p->head) * sizeof(*p->seqs));
+        p->len -= p->head;
+        p->head = 0;
+    }
+}
+
+// Grow the table, dropping trigrams whose entries have all been evicted
+static void tri_rehash(void) {
+    uint32_t *okeys = tri_keys;
+    Posting *olists = tri_lists;
+    size_t ocap = tri_cap, live = 0;
+    for (size_t i = 0; i < ocap; i++) if (okeys[i]) {
+        posting_prune(&olists[i]);
+        if (olists[i].len > olists[i].head) live++;
+    }
+    tri_cap = ocap ? ocap : 4096;
+    while (live * 4 >= tri_cap) tri_cap *= 2;
+    tri_keys = calloc(tri_cap, sizeof(*tri_keys));
+    tri_lists = calloc(tri_cap, sizeof(*tri_lists));
+    if (!tri_keys || !tri_lists) die("calloc");
+    tri_used = 0;
+    for (size_t i = 0; i < ocap; i++) if (okeys[i]) {
+        if (olists[i].len == olists[i].head) { free(olists[i].seqs); continue; }
+        size_t j = tri_slot(okeys[i]);
+        tri_keys[j] = okeys[i];
+        tri_lists[j] = olists[i];
+        tri_used++;
+    }
+    free(okeys);
+    free(olists);
+}
+
+static Posting *tri_find(const char *s) {
+    if (!tri_cap) return NULL;
+    size_t i = tri_slot(TRI_KEY(s));
+    if (!tri_keys[i]) return NULL;
+    posting_prune(&tri_lists[i]);
+    return &tri_lists[i];
+}
+
+static void index_add(const char *s, size_t n, uint32_t seq) {
+    for (size_t k = 0; k + 3 <= n; k++) {
+        if ((tri_used + 1) * 2 > tri_cap) tri_rehash();
+        uint32_t key = TRI_KEY(s + k);
+        size_t i = tri_slot(key);
+        if (!tri_keys[i]) { tri_keys[i] = key; tri_lists[i] = (Posting){ 0 }; tri_used++; }
+        Posting *p = &tri_lists[i];
+        if (p->len > p->head && p->seqs[p->len - 1] == seq) continue;  // repeated in this entry
+        if (p->len == p->cap) {
+            posting_prune(p);
+            if (p->len == p->cap) {
+                p->cap = p->cap ? p->cap * 2 : 4;
+                p->seqs = realloc(p->seqs, p->cap * sizeof(*p->seqs));
+                if (!p->seqs) die("realloc");
+            }
+        }
+        p->seqs[p->len++] = seq;
+    }
+}
+
+// Shortest posting list among the trigrams of s[0..n), NULL if one is absent
+static Posting *rarest(const char *s, size_t n) {
+    Posting *best = NULL;
+    for (size_t k = 0; k + 3 <= n; k++) {
+        Posting *p = tri_find(s + k);
+        if (!p || p->len == p->head) return NULL;
+        if (!best || p->len - p->head < best->len - best->head) best = p;
+    }
+    return best;
+}
+
+static size_t history_len(void) { return next_seq - first_seq; }
+static const HistEntry *slot(uint32_t seq) { return &entries[seq % HISTORY_MAX]; }
+static const char *entry(uint32_t seq) { return arena + slot(seq)->off % HISTORY_ARENA_SIZE; }
+
 static void history_set_path(void) {
     const char *home = getenv("HOME");
     if (!home) { history_path[0] = '\0'; return; }
     snprintf(history_path, sizeof(history_path), "%s/.myterm_history", home);
 }
 
+// Appends go through one O_APPEND descriptor and are batched until the
+// next history_flush(); each flush is a single write of whole lines.
+static int history_fd = -1;
+static char pending[16 * 1024];
+static size_t pending_len = 0;
+
+// The file doubles as a log shared with other MyTerm instances: O_APPEND
+// writes of whole lines do not interleave, so history_sync() can pick up
+// whatever was appended past read_off. Our own writes are skipped by
+// remembering where they landed.
+static uint64_t read_off = 0;
+static struct { uint64_t start, end; } own[64];
+static int nown = 0;
+
+static void history_add_n(const char *line, size_t n);
+
 void history_init(void) {
     history_set_path();
 }
@@ -29,72 +167,229 @@ void history_init(void) {
 void history_load(void) {
     history_set_path();
     if (!*history_path) return;
-    FILE *f = fopen(history_path, "r"); if (!f) return;
-    char *line = NULL; size_t cap = 0; ssize_t n;
-    while ((n = getline(&line, &cap, f)) != -1) {
-        if (n>0 && (line[n-1]=='\n' || line[n-1]=='\r')) line[n-1]='\0';
-        add_history(line);
+    if (history_fd == -1) {
+        history_fd = open(history_path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (history_fd != -1) atexit(history_flush);
+    }
+    int fd = open(history_path, O_RDONLY | O_CLOEXEC); if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) { close(fd); return; }
+    size_t size = (size_t)st.st_size;
+    read_off = size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    // Walk back from the end to the start of the last HISTORY_MAX non-empty
+    // lines, so only the tail of a long file is ever paged in
+    const char *start = map, *end = map + size;
+    size_t lines = 0;
+    while (end > map) {
+        const char *nl = memrchr(map, '\n', (size_t)(end - map - 1));
+        const char *ls = nl ? nl + 1 : map;
+        size_t len = (size_t)(end - ls) - (end[-1] == '\n');
+        if (len > 0 && ++lines > HISTORY_MAX) { start = end; break; }
+        end = ls;
+        if (!nl) break;
     }
-    free(line); fclose(f);
+    for (const char *p = start; p < map + size;) {
+        const char *nl = memchr(p, '\n', (size_t)(map + size - p));
+        const char *le = nl ? nl : map + size;
+        size_t n = (size_t)(le - p);
+        if (n > 0 && p[n-1] == '\r') n--;
+        history_add_n(p, n);
+        p = le + 1;
+    }
+    // terminate an unfinished last line before our first append
+    if (map[size - 1] != '\n' && pending_len == 0) pending[pending_len++] = '\n';
+    munmap((void *)map, size);
 }
 
-void history_save_append(const char *line) {
-    if (!*history_path) return;
-    FILE *f = fopen(history_path, "a"); if (!f) return;
-    fprintf(f, "%s\n", line);
-    fclose(f);
+static void write_out(const char *buf, size_t len) {
+    size_t done = 0;
+    while (history_fd != -1 && done < len) {
+        ssize_t w = write(history_fd, buf + done, len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        // with O_APPEND the offset now sits right after what we wrote
+        off_t at = lseek(history_fd, 0, SEEK_CUR);
+        if (at >= 0) {
+            uint64_t end = (uint64_t)at, start = end - (uint64_t)w;
+            if (start == read_off) read_off = end;   // nobody else appended meanwhile
+            else if (nown < (int)(sizeof(own) / sizeof(own[0]))) { own[nown].start = start; own[nown].end = end; nown++; }
+        }
+        done += (size_t)w;
+    }
 }
 
-void add_history(const char *line) {
-    if (!line || !*line) return;
-    if (history_count == HISTORY_MAX) {
-        free(history[0]);
-        memmove(&history[0], &history[1], sizeof(char*) * (HISTORY_MAX - 1));
-        history_count--;
+void history_flush(void) {
+    if (!pending_len) return;
+    history_sync();
+    write_out(pending, pending_len);
+    pending_len = 0;
+}
+
+static int is_own(uint64_t off) {
+    for (int i = 0; i < nown; i++) if (off >= own[i].start && off < own[i].end) return 1;
+    return 0;
+}
+
+void history_sync(void) {
+    static char buf[64 * 1024];
+    struct stat st;
+    if (history_fd == -1 || fstat(history_fd, &st) < 0) return;
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < read_off) { read_off = size; nown = 0; return; }   // truncated
+    while (read_off < size) {
+        size_t want = size - read_off < sizeof(buf) ? (size_t)(size - read_off) : sizeof(buf);
+        ssize_t r = pread(history_fd, buf, want, (off_t)read_off);
+        if (r <= 0) break;
+        // only complete lines; a partial one is picked up next time
+        const char *last = memrchr(buf, '\n', (size_t)r);
+        if (!last) {
+            if ((size_t)r < sizeof(buf)) break;
+            read_off += (uint64_t)r;   // a line longer than buf: skip it
+            continue;
+        }
+        for (const char *p = buf; p <= last;) {
+            const char *nl = memchr(p, '\n', (size_t)(last - p) + 1);
+            size_t n = (size_t)(nl - p);
+            if (n > 0 && p[n-1] == '\r') n--;
+            if (!is_own(read_off + (uint64_t)(p - buf))) history_add_n(p, n);
+            p = nl + 1;
+        }
+        read_off += (uint64_t)(last - buf) + 1;
     }
-    history[history_count++] = strdup(line);
+    // forget own ranges we have read past
+    int k = 0;
+    for (int i = 0; i < nown; i++) if (own[i].end > read_off) own[k++] = own[i];
+    nown = k;
 }
 
-static int longest_common_substr_len(const char *a, const char *b) {
-    int la = (int)strlen(a), lb = (int)strlen(b);
-    int best = 0;
-    for (int i=0;i<la;i++) for (int j=0;j<lb;j++) {
-        int k=0; while (i+k<la && j+k<lb && a[i+k]==b[j+k]) k++;
-        if (k>best) best=k;
+void history_save_append(const char *line) {
+    if (history_fd == -1) return;
+    size_t n = strlen(line);
+    if (pending_len + n + 1 > sizeof(pending)) history_flush();
+    if (n + 1 > sizeof(pending)) {
+        // too long to batch: write it out directly
+        history_sync();
+        write_out(line, n);
+        write_out("\n", 1);
+        return;
     }
-    return best;
+    memcpy(pending + pending_len, line, n);
+    pending[pending_len + n] = '\n';
+    pending_len += n + 1;
 }
 
-void print_history_command(void) {
-    size_t start = history_count > 1000 ? history_count - 1000 : 0;
-    for (size_t i = start; i < history_count; i++) {
+void add_history(const char *line) {
+    if (line) history_add_n(line, strlen(line));
+}
+
+static void history_add_n(const char *line, size_t n) {
+    if (n == 0 || n >= HISTORY_ARENA_SIZE / 2) return;
+    // text must be contiguous: skip the arena's tail if it is too short
+    size_t pos = (size_t)(arena_end % HISTORY_ARENA_SIZE);
+    if (pos + n + 1 > HISTORY_ARENA_SIZE) arena_end += HISTORY_ARENA_SIZE - pos;
+    // evict oldest entries until the entry slot and the text fit
+    if (history_len() == HISTORY_MAX) first_seq++;
+    while (history_len() && arena_end + n + 1 - slot(first_seq)->off > HISTORY_ARENA_SIZE) first_seq++;
+    memcpy(arena + arena_end % HISTORY_ARENA_SIZE, line, n);
+    arena[arena_end % HISTORY_ARENA_SIZE + n] = '\0';
+    entries[next_seq % HISTORY_MAX] = (HistEntry){ .off = arena_end, .len = (uint32_t)n };
+    arena_end += n + 1;
+    index_add(line, n, next_seq++);
+}
+
+void print_history_command(BuiltinIO *io) {
+    size_t start = history_len() > 1000 ? history_len() - 1000 : 0;
+    for (size_t i = start; i < history_len(); i++) {
         char line[128];
         int n = snprintf(line, sizeof(line), "%zu  ", i + 1);
-        append_output(line, (size_t)n);
-        append_output_str(history[i]);
-        append_output_str("\n");
+        builtin_out(io, line, (size_t)n);
+        builtin_out(io, entry(first_seq + (uint32_t)i), slot(first_seq + (uint32_t)i)->len);
+        builtin_out(io, "\n", 1);
     }
 }
 
-void history_search_and_print(const char *term) {
-    for (ssize_t i=(ssize_t)history_count-1;i>=0;i--) {
-        if (strcmp(history[i], term)==0) {
-            append_output_str(history[i]);
-            append_output_str("\n");
-            return;
+// Does some entry contain a k-byte substring of term? With hits != NULL,
+// marks every such entry instead of stopping at the first one.
+static int match_k(const char *term, size_t m, size_t k, unsigned char *hits) {
+    int found = 0;
+    for (size_t i = 0; i + k <= m; i++) {
+        Posting *p = rarest(term + i, k);
+        if (!p) continue;
+        for (uint32_t j = p->head; j < p->len; j++) {
+            // a single trigram's list is exact; longer needles need checking
+            if (k > 3 && !memmem(entry(p->seqs[j]), slot(p->seqs[j])->len, term + i, k)) continue;
+            if (!hits) return 1;
+            hits[p->seqs[j] - first_seq] = 1;
+            found = 1;
         }
     }
-    int best = 0;
-    for (size_t i=0;i<history_count;i++) {
-        int l = longest_common_substr_len(history[i], term);
-        if (l>best) best=l;
+    return found;
+}
+
+void history_search_and_print(const char *term) {
+    size_t m = strlen(term);
+    // exact match: most recent entry equal to term
+    Posting *p = m >= 3 ? rarest(term, m) : NULL;
+    if (p) {
+        for (uint32_t j = p->len; j-- > p->head;)
+            if (slot(p->seqs[j])->len == m && memcmp(entry(p->seqs[j]), term, m) == 0) {
+                append_output_str(entry(p->seqs[j]));
+                append_output_str("\n");
+                return;
+            }
+    } else if (m > 0 && m < 3) {
+        for (uint32_t q = next_seq; q-- > first_seq;)
+            if (slot(q)->len == m && memcmp(entry(q), term, m) == 0) {
+                append_output_str(entry(q));
+                append_output_str("\n");
+                return;
+            }
     }
-    if (best>2) {
-        for (size_t i=0;i<history_count;i++) {
-            int l = longest_common_substr_len(history[i], term);
-            if (l==best) { append_output_str(history[i]); append_output_str("\n"); }
-        }
-    } else {
+    // longest common substring: an entry shares k bytes with term iff it
+    // contains one of term's k-byte substrings, which is monotone in k
+    if (m < 3 || !match_k(term, m, 3, NULL)) {
         append_output_str("No match for search term in history\n");
+        return;
+    }
+    size_t lo = 3, hi = m;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (match_k(term, m, mid, NULL)) lo = mid; else hi = mid - 1;
+    }
+    static unsigned char hits[HISTORY_MAX];
+    memset(hits, 0, history_len());
+    match_k(term, m, lo, hits);
+    for (size_t i = 0; i < history_len(); i++)
+        if (hits[i]) { append_output_str(entry(first_seq + (uint32_t)i)); append_output_str("\n"); }
+}
+
+const char *history_find(const char *term, long *pos) {
+    size_t m = strlen(term);
+    if (!m || !history_len()) return NULL;
+    uint32_t from = next_seq - 1;
+    if (*pos >= 0) {
+        if ((uint32_t)*pos < first_seq) return NULL;
+        if ((uint32_t)*pos < from) from = (uint32_t)*pos;
+    }
+    if (m < 3) {
+        for (uint32_t s = from + 1; s-- > first_seq;)
+            if (strstr(entry(s), term)) { *pos = (long)s; return entry(s); }
+        return NULL;
+    }
+    Posting *p = rarest(term, m);
+    if (!p) return NULL;
+    // last list position with seq <= from
+    uint32_t lo = p->head, hi = p->len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->seqs[mid] <= from) lo = mid + 1; else hi = mid;
+    }
+    for (uint32_t j = lo; j-- > p->head;) {
+        const char *e = entry(p->seqs[j]);
+        if (m == 3 || memmem(e, slot(p->seqs[j])->len, term, m)) { *pos = (long)p->seqs[j]; return e; }
     }
+    return NULL;
 }
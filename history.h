@@ -2,12 +2,24 @@
 #define HISTORY_H
 
 #include <stddef.h>
+#include "builtins.h"
 
 void history_init(void);
 void history_load(void);
 void history_save_append(const char *line);
+// Write out appends batched by history_save_append(); called once per
+// event-loop tick and at exit.
+void history_flush(void);
+// Pick up commands other MyTerm instances appended to the history file;
+// called at the start of every event-loop tick.
+void history_sync(void);
 void add_history(const char *line);
-void print_history_command(void);
+void print_history_command(BuiltinIO *io);
 void history_search_and_print(const char *term);
+// Incremental search: newest entry containing term whose position is at or
+// before *pos (-1 = newest). On a hit, *pos is set to its position; pass it
+// back unchanged while term grows, or *pos - 1 to step to the next older hit.
+// The result is valid until the next add_history().
+const char *history_find(const char *term, long *pos);
 
 #endif // HISTORY_H
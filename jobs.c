@@ -0,0 +1,407 @@
+// Job control: the central SIGCHLD reaper and the table of background and
+// stopped jobs. Every pipeline runs in a process group of its own, so fg,
+// bg, kill %n and Ctrl+C / Ctrl+Z signal the whole group at once.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "myterm.h"
+#include "exec.h"
+#include "jobs.h"
+
+// Bytes read from one job pipe per wakeup
+#ifndef JOB_READ_BUDGET
+#define JOB_READ_BUDGET (256 * 1024)
+#endif
+
+// ---- reaper: pid -> owner, open addressing with backward-shift deletion ----
+typedef struct {
+    pid_t pid;          // 0 = empty slot
+    ChildFn fn;
+    void *owner;
+} Watch;
+
+static Watch *watches;
+static size_t nslots, nwatched;
+
+static size_t home_slot(pid_t pid) {
+    return ((uint32_t)pid * 2654435761u) & (nslots - 1);
+}
+
+static void watch_put(pid_t pid, ChildFn fn, void *owner) {
+    size_t i = home_slot(pid);
+    while (watches[i].pid && watches[i].pid != pid) i = (i + 1) & (nslots - 1);
+    if (!watches[i].pid) nwatched++;
+    watches[i] = (Watch){ pid, fn, owner };
+}
+
+void child_watch(pid_t pid, ChildFn fn, void *owner) {
+    if (pid <= 0) return;
+    if ((nwatched + 1) * 2 > nslots) {
+        // keep the load at or below one half
+        Watch *old = watches;
+        size_t oldn = nslots;
+        nslots = oldn ? oldn * 2 : 64;
+        watches = calloc(nslots, sizeof(Watch));
+        if (!watches) die("calloc");
+        nwatched = 0;
+        for (size_t i = 0; i < oldn; i++) if (old[i].pid) watch_put(old[i].pid, old[i].fn, old[i].owner);
+        free(old);
+    }
+    watch_put(pid, fn, owner);
+}
+
+static void watch_remove(size_t i) {
+    size_t mask = nslots - 1;
+    watches[i].pid = 0;
+    nwatched--;
+    // pull later entries of the probe run back over the hole
+    for (size_t j = (i + 1) & mask; watches[j].pid; j = (j + 1) & mask) {
+        size_t h = home_slot(watches[j].pid);
+        int between = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+        if (between) continue;
+        watches[i] = watches[j];
+        watches[j].pid = 0;
+        i = j;
+    }
+}
+
+void child_dispatch(pid_t pid, int wstatus) {
+    if (!nslots) return;
+    size_t i = home_slot(pid);
+    while (watches[i].pid && watches[i].pid != pid) i = (i + 1) & (nslots - 1);
+    if (!watches[i].pid) return;
+    Watch w = watches[i];
+    if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) watch_remove(i);
+    w.fn(w.owner, pid, wstatus);
+}
+
+void reap_children(void) {
+    int st;
+    pid_t pid;
+    while ((pid = waitpid(-1, &st, WNOHANG | WUNTRACED | WCONTINUED)) > 0) child_dispatch(pid, st);
+}
+
+static void capture_child(void *owner, pid_t pid, int wstatus) {
+    Capture *c = owner;
+    for (int k = 0; k < c->nstages; k++) {
+        if (c->pids[k] != pid) continue;
+        if (WIFSTOPPED(wstatus)) { if (c->active) job_adopt(c); return; }
+        if (WIFCONTINUED(wstatus)) return;
+        c->pids[k] = 0;
+        if (k == c->nstages - 1) c->status = exit_status(wstatus);
+        return;
+    }
+}
+
+void capture_watch(Capture *c) {
+    for (int k = 0; k < c->nstages; k++) child_watch(c->pids[k], capture_child, c);
+}
+
+// ---- job table ----
+enum { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+typedef struct {
+    int used;
+    int state;
+    pid_t pgid;
+    pid_t pids[MAX_PIPE];   // 0 once reaped
+    int nstages;
+    int status;             // of the last stage
+    int out_fd, err_fd;     // -1 at EOF
+    char *buf;              // output not shown yet
+    size_t len, cap;
+    size_t dropped;         // oldest output discarded past JOB_OUTPUT_MAX
+    Capture *tab;           // where notifications go; NULL once detached
+    unsigned long seq;      // recency: the highest is the current job
+    char command[sizeof(((Capture *)0)->command)];
+} Job;
+
+static Job jobs[MAX_JOBS];
+static unsigned long job_seq;
+
+static int job_id(const Job *j) { return (int)(j - jobs) + 1; }
+
+static Job *current_job(void) {
+    Job *cur = NULL;
+    for (int i = 0; i < MAX_JOBS; i++) if (jobs[i].used && (!cur || jobs[i].seq > cur->seq)) cur = &jobs[i];
+    return cur;
+}
+
+static void state_name(const Job *j, char *buf, size_t n) {
+    if (j->state == JOB_RUNNING) snprintf(buf, n, "Running");
+    else if (j->state == JOB_STOPPED) snprintf(buf, n, "Stopped");
+    else if (j->status) snprintf(buf, n, "Exit %d", j->status);
+    else snprintf(buf, n, "Done");
+}
+
+static int job_line(const Job *j, char *buf, size_t n) {
+    char state[32];
+    state_name(j, state, sizeof(state));
+    int len = snprintf(buf, n, "[%d]%c  %-22s %s%s", job_id(j), j == current_job() ? '+' : ' ', state,
+                       j->command, j->state == JOB_RUNNING ? " &" : "");
+    if (j->len && len < (int)n) len += snprintf(buf + len, n - (size_t)len, "  (%zu bytes of output)", j->len);
+    if (len >= (int)n - 1) len = (int)n - 2;
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    return len;
+}
+
+static void job_notify(const Job *j) {
+    if (!j->tab) return;
+    char line[512];
+    int n = job_line(j, line, sizeof(line));
+    capture_output(j->tab, line, (size_t)n);
+}
+
+static void job_free(Job *j) {
+    if (j->out_fd != -1) close(j->out_fd);
+    if (j->err_fd != -1) close(j->err_fd);
+    free(j->buf);
+    memset(j, 0, sizeof(*j));
+}
+
+static int job_alive(const Job *j) {
+    for (int k = 0; k < j->nstages; k++) if (j->pids[k] > 0) return 1;
+    return 0;
+}
+
+// Report the job once its processes are gone; forget it once there is
+// nothing left to read or nowhere to show it. Output still held is shown
+// by jobs_report() at the tab's next prompt.
+static void job_update(Job *j) {
+    if (j->state != JOB_DONE && !job_alive(j)) { j->state = JOB_DONE; job_notify(j); }
+    if (j->state == JOB_DONE && j->out_fd == -1 && j->err_fd == -1 && (!j->len || !j->tab)) job_free(j);
+}
+
+// The job's buffered output, into capture c
+static void job_show(const Job *j, Capture *c) {
+    if (j->dropped) {
+        char msg[64];
+        int n = snprintf(msg, sizeof(msg), "[%zu bytes of output dropped]\n", j->dropped);
+        capture_output(c, msg, (size_t)n);
+    }
+    capture_output(c, j->buf, j->len);
+}
+
+static void job_child(void *owner, pid_t pid, int wstatus) {
+    Job *j = owner;
+    for (int k = 0; k < j->nstages; k++) {
+        if (j->pids[k] != pid) continue;
+        if (WIFSTOPPED(wstatus)) {
+            if (j->state == JOB_RUNNING) { j->state = JOB_STOPPED; job_notify(j); }
+        } else if (WIFCONTINUED(wstatus)) {
+            if (j->state == JOB_STOPPED) j->state = JOB_RUNNING;
+        } else {
+            j->pids[k] = 0;
+            if (k == j->nstages - 1) j->status = exit_status(wstatus);
+        }
+        break;
+    }
+    job_update(j);
+}
+
+static Job *job_slot(void) {
+    for (int i = 0; i < MAX_JOBS; i++) if (!jobs[i].used) return &jobs[i];
+    return NULL;
+}
+
+int jobs_full(void) { return job_slot() == NULL; }
+
+int job_add(Capture *c, const pid_t *pids, int nstages, pid_t pgid, int out, int err, const char *command) {
+    Job *j = job_slot();
+    if (!j) return -1;
+    *j = (Job){ .used = 1, .state = JOB_RUNNING, .pgid = pgid, .nstages = nstages,
+                .out_fd = out, .err_fd = err, .tab = c, .seq = ++job_seq };
+    snprintf(j->command, sizeof(j->command), "%s", command);
+    for (int k = 0; k < nstages; k++) { j->pids[k] = pids[k]; child_watch(pids[k], job_child, j); }
+    return job_id(j);
+}
+
+void job_adopt(Capture *c) {
+    Job *j = job_slot();
+    if (!j) {
+        // nowhere to put it: it stays in the tab
+        kill(-c->pgid, SIGCONT);
+        capture_output(c, "myterm: too many jobs\n", 22);
+        return;
+    }
+    job_add(c, c->pids, c->nstages, c->pgid, c->out_fd, c->err_fd, c->command);
+    j->state = JOB_STOPPED;
+    j->status = c->status;
+    c->out_fd = c->err_fd = -1;
+    c->active = 0;
+    c->fg_child = -1;
+    c->pgid = 0;
+    plan_abort(c);
+    trace_mark(&c->tl, TRACE_EXIT);
+    trace_settle(&c->tl);
+    job_notify(j);
+    invalidate(DAMAGE_INPUT);
+}
+
+void jobs_hangup(Capture *c) {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        Job *j = &jobs[i];
+        if (!j->used || (c && j->tab != c)) continue;
+        if (j->state != JOB_DONE) { kill(-j->pgid, SIGHUP); kill(-j->pgid, SIGCONT); }
+        j->tab = NULL;
+        // output held for the tab has nowhere to go now
+        job_update(j);
+    }
+}
+
+void jobs_forget(void) {
+    for (int i = 0; i < MAX_JOBS; i++) free(jobs[i].buf);
+    memset(jobs, 0, sizeof(jobs));
+    free(watches);
+    watches = NULL;
+    nslots = nwatched = 0;
+}
+
+int jobs_pollfds(struct pollfd *p, int max) {
+    int n = 0;
+    for (int i = 0; i < MAX_JOBS && n + 2 <= max; i++) {
+        if (!jobs[i].used) continue;
+        if (jobs[i].out_fd != -1) p[n++] = (struct pollfd){ .fd = jobs[i].out_fd, .events = POLLIN };
+        if (jobs[i].err_fd != -1) p[n++] = (struct pollfd){ .fd = jobs[i].err_fd, .events = POLLIN };
+    }
+    return n;
+}
+
+// Append what is waiting in *fd to the job's buffer, keeping the newest
+// JOB_OUTPUT_MAX bytes; closes the pipe at EOF
+static void job_read(Job *j, int *fd) {
+    size_t budget = JOB_READ_BUDGET;
+    while (budget > 0) {
+        if (j->cap - j->len < 4096) {
+            if (j->cap < JOB_OUTPUT_MAX) {
+                size_t cap = j->cap ? j->cap * 2 : 16384;
+                if (cap > JOB_OUTPUT_MAX) cap = JOB_OUTPUT_MAX;
+                char *buf = realloc(j->buf, cap);
+                if (!buf) die("realloc");
+                j->buf = buf;
+                j->cap = cap;
+            } else {
+                size_t drop = j->len / 2;
+                memmove(j->buf, j->buf + drop, j->len - drop);
+                j->len -= drop;
+                j->dropped += drop;
+            }
+        }
+        ssize_t r = read(*fd, j->buf + j->len, j->cap - j->len);
+        if (r > 0) { j->len += (size_t)r; budget = (size_t)r < budget ? budget - (size_t)r : 0; continue; }
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+        close(*fd);
+        *fd = -1;
+        break;
+    }
+}
+
+void jobs_pump(const struct pollfd *p, int n) {
+    for (int k = 0; k < n; k++) {
+        if (!p[k].revents) continue;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            Job *j = &jobs[i];
+            if (!j->used) continue;
+            if (j->out_fd == p[k].fd) job_read(j, &j->out_fd);
+            else if (j->err_fd == p[k].fd) job_read(j, &j->err_fd);
+            else continue;
+            job_update(j);
+            break;
+        }
+    }
+}
+
+int job_find(const char *spec) {
+    if (!spec || !strcmp(spec, "%") || !strcmp(spec, "%%") || !strcmp(spec, "%+")) {
+        Job *j = current_job();
+        return j ? job_id(j) : -1;
+    }
+    if (*spec == '%') spec++;
+    char *end;
+    long id = strtol(spec, &end, 10);
+    if (*end || id < 1 || id > MAX_JOBS || !jobs[id - 1].used) return -1;
+    return (int)id;
+}
+
+int job_foreground(int id, Capture *c) {
+    Job *j = &jobs[id - 1];
+    capture_output(c, j->command, strlen(j->command));
+    capture_output(c, "\n", 1);
+    job_show(j, c);
+    if (j->state == JOB_DONE && j->out_fd == -1 && j->err_fd == -1) {
+        int status = j->status;
+        job_free(j);
+        return status;
+    }
+    // the tab reads and reaps it from here on
+    c->pgid = j->pgid;
+    c->nstages = j->nstages;
+    memcpy(c->pids, j->pids, sizeof(j->pids));
+    c->out_fd = j->out_fd;
+    c->err_fd = j->err_fd;
+    c->status = j->status;
+    c->fg_child = j->pids[j->nstages - 1];
+    c->active = 1;
+    snprintf(c->command, sizeof(c->command), "%s", j->command);
+    capture_watch(c);
+    if (j->state == JOB_STOPPED) kill(-j->pgid, SIGCONT);
+    j->out_fd = j->err_fd = -1;
+    job_free(j);
+    return 0;
+}
+
+void jobs_report(void) {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        Job *j = &jobs[i];
+        if (!j->used || j->state != JOB_DONE || j->out_fd != -1 || j->err_fd != -1 || !j->tab || j->tab->active) continue;
+        char head[sizeof(j->command) + 32];
+        int n = snprintf(head, sizeof(head), "[%d]  output of %s:\n", job_id(j), j->command);
+        capture_output(j->tab, head, n < (int)sizeof(head) ? (size_t)n : sizeof(head) - 1);
+        job_show(j, j->tab);
+        job_free(j);
+    }
+}
+
+int job_background(int id, BuiltinIO *io) {
+    Job *j = &jobs[id - 1];
+    if (j->state == JOB_DONE) return -1;
+    if (j->state == JOB_STOPPED) {
+        kill(-j->pgid, SIGCONT);
+        j->state = JOB_RUNNING;
+    }
+    j->seq = ++job_seq;
+    char line[512];
+    int n = job_line(j, line, sizeof(line));
+    builtin_out(io, line, (size_t)n);
+    return 0;
+}
+
+int job_signal(int id, int sig) {
+    Job *j = &jobs[id - 1];
+    if (j->state == JOB_DONE) { errno = ESRCH; return -1; }
+    if (kill(-j->pgid, sig) < 0) return -1;
+    // a stopped process only acts on the signal once it runs again
+    if (j->state == JOB_STOPPED && sig != SIGSTOP && sig != SIGTSTP && sig != SIGCONT) kill(-j->pgid, SIGCONT);
+    return 0;
+}
+
+int print_jobs_command(BuiltinIO *io) {
+    int shown = 0;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        Job *j = &jobs[i];
+        if (!j->used) continue;
+        char line[512];
+        int n = job_line(j, line, sizeof(line));
+        builtin_out(io, line, (size_t)n);
+        shown++;
+    }
+    return shown;
+}
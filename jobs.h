@@ -0,0 +1,61 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <poll.h>
+#include <sys/types.h>
+#include "myterm.h"
+#include "builtins.h"
+
+// Central child reaper. SIGCHLD arrives on the main loop's signalfd and
+// reap_children() collects every exited, stopped or continued child with
+// one waitpid(-1) loop, handing each to the owner it was registered with
+// (a tab's capture or a job). Unknown children are reaped and dropped.
+typedef void (*ChildFn)(void *owner, pid_t pid, int wstatus);
+void child_watch(pid_t pid, ChildFn fn, void *owner);
+void child_dispatch(pid_t pid, int wstatus);
+void reap_children(void);
+// Route the exits of c's pipeline to c: pids[] are cleared as stages exit,
+// c->status takes the last stage's status, a stop moves it to the job table
+void capture_watch(Capture *c);
+
+// Job table: pipelines started with '&' or stopped with Ctrl+Z. Each one is
+// a process group of its own; its output is read by the main loop into a
+// per-job buffer and shown when it is brought back with `fg`, or at the
+// next prompt once the job has finished.
+#ifndef JOB_OUTPUT_MAX
+#define JOB_OUTPUT_MAX (1024 * 1024)
+#endif
+
+// Room for another job?
+int jobs_full(void);
+// Add a started pipeline (pids[nstages], pgid, capture pipes out/err) as a
+// running job owned by c's tab; returns its id
+int job_add(Capture *c, const pid_t *pids, int nstages, pid_t pgid, int out, int err, const char *command);
+// Move c's stopped pipeline into the table
+void job_adopt(Capture *c);
+// Hang up the jobs of c's tab (NULL: every job), e.g. when it closes
+void jobs_hangup(Capture *c);
+// A forked stage starts with no jobs of its own
+void jobs_forget(void);
+
+// Main loop: the job pipes to poll, and reading them once poll() returns
+int jobs_pollfds(struct pollfd *p, int max);
+void jobs_pump(const struct pollfd *p, int n);
+
+// Builtins. job_find() takes "%n", "n", "%%", "%+" or NULL for the current
+// job and returns its id, or -1.
+int job_find(const char *spec);
+// At the prompt: finished jobs whose tab is idle show the output they
+// still hold there and give up their slot, as a shell reports done jobs
+void jobs_report(void);
+// `fg`: move the job into capture c after writing its buffered output to
+// the tab; returns its status if it had already finished, else 0
+int job_foreground(int id, Capture *c);
+// `bg`: let a stopped job run on; -1 if it has finished
+int job_background(int id, BuiltinIO *io);
+// `kill %n`: signal the job's process group, waking it if it is stopped
+int job_signal(int id, int sig);
+// `jobs`: one line per job; returns how many
+int print_jobs_command(BuiltinIO *io);
+
+#endif // JOBS_H
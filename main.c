@@ -1,7 +1,4 @@
 #define _XOPEN_SOURCE 700
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <X11/keysym.h>
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,15 +7,23 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
-#include <dirent.h>
 #include <time.h>
 #include <poll.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
 #include "myterm.h"
 #include "history.h"
 #include "exec.h"
 #include "multiwatch.h"
+#include "scrollback.h"
+#include "vt.h"
+#include "backend.h"
+#include "complete.h"
+#include "jobs.h"
+#include "main.h"
 
 #define BUF_SIZE 8192
 #define MAX_INPUT 1024
@@ -27,15 +32,13 @@
 #define HISTORY_MAX 10000
 #define MAX_TABS 8
 
-static Display *dpy;
-Display *dpy_global;  // exported for multiWatch event checking
-static Window win;
-static GC gc;
-static int screen;
-static XFontStruct *fontinfo = NULL;
+static const Backend *ui;      // rendering/input backend (X11 or headless)
+static int font_ascent = 12;
+static int quitting = 0;        // backend asked to quit; exit once jobs are done
 typedef struct {
-    char textbuf[BUF_SIZE];
-    size_t textlen;
+    Scrollback sb;      // output scrollback
+    Vt vt;              // escape sequence state of the output, across reads
+    Capture cap;        // foreground job running in this tab
     char inputbuf[MAX_INPUT];
     size_t inputlen;
     size_t cursor_idx;
@@ -47,12 +50,6 @@ static int active_tab = 0;
 static char inputbuf[MAX_INPUT]; // legacy alias to active tab buffer for minimal edits
 static size_t inputlen = 0;
 static size_t cursor_idx = 0; // for Ctrl+A/E navigation
-pid_t fg_child = -1;   // foreground child pid for signals
-volatile int interrupt_requested = 0;  // set by Ctrl+C handler
-
-// Background job tracking
-BackgroundJob bg_jobs[MAX_JOBS];
-int bg_job_count = 0;
 static int line_height = 16;
 static int win_width = 900, win_height = 600;
 static int scroll_offset = 0; // number of lines scrolled up from bottom
@@ -60,26 +57,24 @@ static int scroll_offset = 0; // number of lines scrolled up from bottom
 static int search_mode = 0; // 0 normal, 1 waiting for search term
 static char searchbuf[MAX_INPUT];
 static size_t searchlen = 0;
+static long search_pos = -1;        // history position of the previewed match
+static char search_hit[MAX_INPUT];  // preview shown while typing
+static int search_failed = 0;       // no (older) entry matches the term
 
 // Tab completion state
 static int completion_mode = 0;  // 0 normal, 1 waiting for selection
-static char completion_matches[512][256];
+static char completion_matches[COMPLETE_MAX][256];
 static int completion_count = 0;
 static size_t completion_token_start = 0;  // Where the token being completed starts
+// Tab pressed while a directory was still being scanned
+static int completion_wait = 0, completion_wait_tab = 0;
+static size_t completion_wait_len = 0, completion_wait_cursor = 0;
 
 // forward declarations
 void append_output(const char *s, size_t n);
 
-// global capture state for the current foreground job (single at a time)
-int cap_out_fd = -1;
-int cap_err_fd = -1;
-pid_t cap_pids[MAX_PIPE];
-int cap_nstages = 0;
-int cap_active = 0;
 void append_output_str(const char *s);
 
-static Colormap cmap;
-static unsigned long col_bg, col_fg, col_tab_active, col_tab_inactive, col_accent;
 static int tab_rect_x[MAX_TABS];
 static int tab_rect_w[MAX_TABS];
 static int tab_close_x[MAX_TABS];
@@ -93,107 +88,249 @@ void die(const char *msg) {
     exit(1);
 }
 
+// SIGCHLD is blocked in the UI process and delivered through sig_fd;
+// children must start with a clean mask before exec.
+static int sig_fd = -1;
+
+void reset_child_signals(void) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
+
+// Damage tracking: regions are marked dirty as state changes and painted
+// together at most once per frame interval.
+#define FRAME_NS (16 * 1000 * 1000)
+static unsigned damage = DAMAGE_ALL;
+static struct timespec last_paint;
+static int painted_prompt_y = -1;   // prompt baseline of the last painted frame
+// Text view of the last painted frame, used to scroll the back buffer by copying
+static int painted_tab = -1, painted_nlines = 0;
+static uint64_t painted_start = 0, painted_end = 0;   // absolute first line, scrollback end
+// multiWatch -p layout of the last painted frame; -1: no panes on screen
+static int painted_panes_tab = -1, painted_panes = 0, painted_pane_rows = 0;
+// Vertical span of the back buffer touched this frame; copied to the window at the end
+static int blit_y0, blit_y1;
+
+static void mark_blit(int y0, int y1) {
+    if (y0 < blit_y0) blit_y0 = y0;
+    if (y1 > blit_y1) blit_y1 = y1;
+}
+static char prompt_cwd[512] = "?";  // cached so painting does not call getcwd()
+
+static void refresh_cwd(void) {
+    if (getcwd(prompt_cwd, sizeof(prompt_cwd)) == NULL) snprintf(prompt_cwd, sizeof(prompt_cwd), "?");
+    damage |= DAMAGE_INPUT;
+}
+
+static void resize_backbuf(int w, int h) {
+    win_width = w; win_height = h;
+    ui->resize(w, h);
+    damage = DAMAGE_ALL;
+}
+
+void invalidate(unsigned regions) {
+    damage |= regions;
+}
+
+void draw(void) {
+    invalidate(DAMAGE_ALL);
+}
 
-void draw() {
-    // Fill background
-    XSetForeground(dpy, gc, col_bg);
-    XFillRectangle(dpy, win, gc, 0, 0, (unsigned)win_width, (unsigned)win_height);
+// Top of the row whose text baseline is y
+static int row_top(int y) { return y - line_height + 4; }
 
+static void paint_tabbar(void) {
+    mark_blit(0, tab_bar_h + 1);
+    ui->fill_rect(COL_BG, 0, 0, win_width, tab_bar_h + 1);
     // Draw tab bar background
-    XSetForeground(dpy, gc, col_tab_inactive);
-    XFillRectangle(dpy, win, gc, 0, 0, (unsigned)win_width, (unsigned)tab_bar_h);
+    ui->fill_rect(COL_TAB_INACTIVE, 0, 0, win_width, tab_bar_h);
 
     // Draw tabs with active styling and close buttons
     int x = 8; // baseline x for tab bar
     for (int i=0;i<MAX_TABS;i++) {
         if (!tab_used[i]) { tab_rect_x[i]=tab_rect_w[i]=tab_close_x[i]=0; continue; }
         char label[32]; snprintf(label, sizeof(label), "Tab %d%s", i+1, i==active_tab?"*":"");
-        int tw = fontinfo ? XTextWidth(fontinfo, label, (int)strlen(label)) : (int)strlen(label)*8;
+        int tw = ui->text_width(label, (int)strlen(label));
         int padx = 14; int closew = 14; int w = tw + padx*2 + closew + 6;
-        int tx = x + padx; int ty = tab_bar_h - (tab_bar_h - (fontinfo?fontinfo->ascent:12)) / 2 - 6;
+        int tx = x + padx; int ty = tab_bar_h - (tab_bar_h - font_ascent) / 2 - 6;
         tab_rect_x[i] = x; tab_rect_w[i] = w; tab_close_x[i] = x + w - closew - 8;
         // Tab background
-        XSetForeground(dpy, gc, i==active_tab ? col_tab_active : col_tab_inactive);
-        XFillRectangle(dpy, win, gc, x, 2, (unsigned)w, (unsigned)(tab_bar_h-4));
+        ui->fill_rect(i==active_tab ? COL_TAB_ACTIVE : COL_TAB_INACTIVE, x, 2, w, (tab_bar_h-4));
         // Tab label
-        XSetForeground(dpy, gc, col_fg);
-        XDrawString(dpy, win, gc, tx, ty, label, (int)strlen(label));
+        ui->draw_text(COL_FG, tx, ty, label, (int)strlen(label));
         // Close button box and X
         int cx = tab_close_x[i]; int cy = 6; int ch = tab_bar_h - 12;
-        XSetForeground(dpy, gc, col_accent);
-        XDrawRectangle(dpy, win, gc, cx, cy, closew, ch);
-        XDrawLine(dpy, win, gc, cx+3, cy+3, cx+closew-3, cy+ch-3);
-        XDrawLine(dpy, win, gc, cx+3, cy+ch-3, cx+closew-3, cy+3);
+        ui->draw_rect(COL_ACCENT, cx, cy, closew, ch);
+        ui->draw_line(COL_ACCENT, cx+3, cy+3, cx+closew-3, cy+ch-3);
+        ui->draw_line(COL_ACCENT, cx+3, cy+ch-3, cx+closew-3, cy+3);
         x += w + 6;
     }
     // New tab "+" button at the end of tab bar
     newtab_x = x + 6; int cy = 6; int ch = tab_bar_h - 12;
-    XSetForeground(dpy, gc, col_accent);
-    XDrawRectangle(dpy, win, gc, newtab_x, cy, newtab_w, ch);
+    ui->draw_rect(COL_ACCENT, newtab_x, cy, newtab_w, ch);
     // plus sign
     int cxm = newtab_x + newtab_w/2;
     int cym = cy + ch/2;
-    XDrawLine(dpy, win, gc, cxm - 5, cym, cxm + 5, cym);
-    XDrawLine(dpy, win, gc, cxm, cym - 5, cxm, cym + 5);
+    ui->draw_line(COL_ACCENT, cxm - 5, cym, cxm + 5, cym);
+    ui->draw_line(COL_ACCENT, cxm, cym - 5, cxm, cym + 5);
     // Bottom border of tab bar
-    XSetForeground(dpy, gc, col_accent);
-    XDrawLine(dpy, win, gc, 0, tab_bar_h, win_width, tab_bar_h);
+    ui->draw_line(COL_ACCENT, 0, tab_bar_h, win_width, tab_bar_h);
+}
 
-    // Text area origin
-    int text_origin_x = 10;
-    int text_origin_y = tab_bar_h + 16;
-    int xdraw = text_origin_x;
+// Draw one line of output starting in colour color; the VT colour markers
+// in it (vt.h) switch to an ANSI colour, the accent, or back
+static void draw_vt_text(int color, int x, int y, const char *s, size_t n) {
+    int cur = color;
+    while (n > 0) {
+        const char *m = memchr(s, VT_ATTR, n);
+        size_t run = m ? (size_t)(m - s) : n;
+        if (run > 0) {
+            ui->draw_text(cur, x, y, s, (int)run);
+            x += ui->text_width(s, (int)run);
+        }
+        if (!m) break;
+        if (run + 1 < n) {
+            unsigned char a = (unsigned char)s[run + 1];
+            cur = a > VT_ATTR_DEFAULT && a <= VT_ATTR_DEFAULT + VT_COLORS ? COL_ANSI + (a - VT_ATTR_DEFAULT - 1) :
+                  a == VT_ATTR_ACCENT ? COL_ACCENT : color;
+        }
+        run = run + 2 < n ? run + 2 : n;
+        s += run; n -= run;
+    }
+}
+
+// Draw scrollback lines [start_line + row_from, start_line + row_to) into their rows
+static void paint_text_rows(Tab *t, int start_line, int row_from, int row_to, int text_origin_x, int text_origin_y) {
+    if (row_to <= row_from) return;
+    int top = row_top(text_origin_y + row_from * line_height);
+    ui->fill_rect(COL_BG, 0, top, win_width, ((row_to - row_from) * line_height));
+    mark_blit(top, top + (row_to - row_from) * line_height);
+    char linebuf[1024];
+    int ydraw = text_origin_y + row_from * line_height;
+    for (int i = start_line + row_from; i < start_line + row_to; i++) {
+        uint64_t ls, le;
+        sb_line(&t->sb, (size_t)i, &ls, &le);
+        size_t len = sb_copy(&t->sb, ls, linebuf, le - ls < sizeof(linebuf) ? (size_t)(le - ls) : sizeof(linebuf));
+        if (len > 0) draw_vt_text(COL_FG, text_origin_x, ydraw, linebuf, len);
+        ydraw += line_height;
+    }
+}
+
+// multiWatch -p: the text area split into one pane per command, each a
+// title row over the newest lines of that command's output (with -n, its
+// last run, changed lines in the accent colour). With the same layout as
+// the last frame only the panes that changed are drawn again.
+static void paint_panes(Tab *t, int npanes, int nlines, int text_origin_x, int text_origin_y, int prompt_y) {
+    int top = tab_bar_h + 1;
+    int rows = npanes ? nlines / npanes : 0;
+    // as many panes as fit with at least one line each
+    if (rows < 2) { rows = 2; npanes = nlines / 2; }
+    int full = painted_panes_tab != active_tab || painted_panes != npanes || painted_pane_rows != rows;
+    painted_panes_tab = active_tab; painted_panes = npanes; painted_pane_rows = rows;
+    painted_tab = -1;   // nothing to scroll from in the next frame
+    if (full) {
+        ui->fill_rect(COL_BG, 0, top, win_width, row_top(prompt_y) - top);
+        mark_blit(top, row_top(prompt_y));
+    }
+    char linebuf[1024];
     int ydraw = text_origin_y;
-    // Draw the accumulated text output with viewport/scrolling
-    Tab *t = &tabs[active_tab];
-    int available_lines = (win_height - ydraw) / line_height - 1; // keep one line for prompt
-    if (available_lines < 0) available_lines = 0;
-    // count total lines
-    int total_lines = 0;
-    for (size_t off=0; off < t->textlen; ) {
-        char *nl = memchr(t->textbuf + off, '\n', t->textlen - off);
-        total_lines++;
-        if (!nl) break; else off = (size_t)((nl + 1) - t->textbuf);
+    for (int p = 0; p < npanes; p++, ydraw += rows * line_height) {
+        if (!multiwatch_pane_dirty(&t->cap, p) && !full) continue;
+        const char *title;
+        size_t total = multiwatch_pane(&t->cap, p, &title);
+        if (!full) {
+            // the pane's rows, below the separator above it
+            int y0 = row_top(ydraw), y1 = row_top(ydraw + rows * line_height) - 1;
+            ui->fill_rect(COL_BG, 0, y0, win_width, y1 - y0);
+            mark_blit(y0, y1);
+        }
+        if (p > 0) ui->draw_line(COL_ACCENT, 0, row_top(ydraw) - 1, win_width, row_top(ydraw) - 1);
+        ui->draw_text(COL_ACCENT, text_origin_x, ydraw, title, (int)strlen(title));
+        size_t show = total < (size_t)(rows - 1) ? total : (size_t)(rows - 1);
+        int y = ydraw + line_height;
+        for (size_t i = total - show; i < total; i++) {
+            int changed;
+            size_t len = multiwatch_pane_line(&t->cap, p, i, linebuf, sizeof(linebuf), &changed);
+            if (len > 0) draw_vt_text(changed ? COL_ACCENT : COL_FG, text_origin_x, y, linebuf, len);
+            y += line_height;
+        }
     }
-    if (t->textlen == 0) total_lines = 0;
-    int max_offset = total_lines > available_lines ? (total_lines - available_lines) : 0;
-    if (scroll_offset > max_offset) scroll_offset = max_offset;
-    if (scroll_offset < 0) scroll_offset = 0;
-    int start_line = total_lines - available_lines - scroll_offset;
-    if (start_line < 0) start_line = 0;
-    int drawn = 0;
-    int current_line = 0;
-    for (size_t off=0; off < t->textlen && drawn < available_lines; ) {
-        char *line_start = t->textbuf + off;
-        char *nl = memchr(line_start, '\n', t->textlen - off);
-        size_t len = nl ? (size_t)(nl - line_start) : (t->textlen - off);
-        if (current_line >= start_line) {
-            if (len > 0) { XSetForeground(dpy, gc, col_fg); XDrawString(dpy, win, gc, xdraw, ydraw, line_start, (int)len); }
-            ydraw += line_height;
-            drawn++;
+}
+
+// Draw the visible slice of the scrollback between the tab bar and the prompt.
+// When the view only moved by whole lines, the pixels already in the back
+// buffer are shifted with one copy and just the exposed rows are drawn.
+static void paint_text(Tab *t, int start_line, int nlines, int text_origin_x, int text_origin_y, int prompt_y) {
+    int incremental = painted_tab == active_tab && nlines == painted_nlines && t->sb.end >= painted_end;
+    uint64_t abs_start = t->sb.first_line + (uint64_t)start_line;
+    int64_t delta = (int64_t)(abs_start - painted_start);
+    int d = delta > nlines ? nlines : delta < -nlines ? -nlines : (int)delta;
+    painted_tab = active_tab; painted_start = abs_start; painted_nlines = nlines; painted_end = t->sb.end;
+    if (incremental && d > -nlines && d < nlines) {
+        int top = row_top(text_origin_y);
+        if (d > 0) {
+            ui->copy_area(0, top + d * line_height, win_width, (nlines - d) * line_height, 0, top);
+        } else if (d < 0) {
+            ui->copy_area(0, top, win_width, (nlines + d) * line_height, 0, top - d * line_height);
+            paint_text_rows(t, start_line, 0, -d, text_origin_x, text_origin_y);
         }
-        current_line++;
-        if (!nl) break; else off = (size_t)((nl + 1) - t->textbuf);
+        if (d != 0) mark_blit(top, top + nlines * line_height);
+        // rows from the previously last line (which may have grown) downward
+        int from = nlines - 1 - d;
+        if (from < 0) from = 0;
+        if (from < nlines) paint_text_rows(t, start_line, from, nlines, text_origin_x, text_origin_y);
+        return;
+    }
+    int h = row_top(prompt_y) - tab_bar_h - 1;
+    if (h > 0) ui->fill_rect(COL_BG, 0, tab_bar_h + 1, win_width, h);
+    mark_blit(tab_bar_h + 1, row_top(prompt_y));
+    paint_text_rows(t, start_line, 0, nlines, text_origin_x, text_origin_y);
+}
+
+// Ctrl+R preview: refresh the match for the current term starting at search_pos
+static void search_update(void) {
+    long pos = search_pos;
+    const char *hit = history_find(searchbuf, &pos);
+    search_failed = searchlen > 0 && !hit;
+    if (hit) { search_pos = pos; snprintf(search_hit, sizeof(search_hit), "%s", hit); }
+    else if (!searchlen) search_hit[0] = '\0';
+    invalidate(DAMAGE_INPUT);
+}
+
+// Draw prompt, multi-line input and caret starting at baseline prompt_y
+static void paint_input(Tab *t, int xdraw, int prompt_y) {
+    int ydraw = prompt_y;
+    ui->fill_rect(COL_BG, 0, row_top(prompt_y), win_width, (win_height - row_top(prompt_y)));
+    mark_blit(row_top(prompt_y), win_height);
+    if (search_mode) {
+        char line[3 * MAX_INPUT];
+        int n = snprintf(line, sizeof(line), "(%sreverse-i-search)`%s': ", search_failed ? "failed " : "", searchbuf);
+        if (n > (int)sizeof(line) - 1) n = (int)sizeof(line) - 1;
+        int caret_x = xdraw + ui->text_width(line, n);
+        n += snprintf(line + n, sizeof(line) - (size_t)n, "%s", search_hit);
+        if (n > (int)sizeof(line) - 1) n = (int)sizeof(line) - 1;
+        ui->draw_text(COL_FG, xdraw, ydraw, line, n);
+        ui->draw_line(COL_ACCENT, caret_x, ydraw + 2, caret_x, ydraw - line_height + 4);
+        return;
     }
     // Draw prompt and current input (use current working directory)
     char prompt[512];
-    char cwd[512];
-    if (getcwd(cwd, sizeof(cwd)) == NULL) snprintf(cwd, sizeof(cwd), "?");
     // Safely build prompt: "<cwd> " ensuring no overflow
-    size_t l = strlen(cwd);
+    size_t l = strlen(prompt_cwd);
     if (l > sizeof(prompt) - 20) l = sizeof(prompt) - 20; // room for indicator + "> " and NUL
-    memcpy(prompt, cwd, l);
+    memcpy(prompt, prompt_cwd, l);
     // Add running indicator if command is active
-    if (cap_active) {
+    if (t->cap.active) {
         memcpy(prompt + l, " [running]", 10);
         l += 10;
     }
     prompt[l] = '>';
     prompt[l+1] = ' ';
     prompt[l+2] = '\0';
-    XSetForeground(dpy, gc, col_fg);
-    XDrawString(dpy, win, gc, xdraw, ydraw, prompt, (int)strlen(prompt));
-    int ix = xdraw + (fontinfo ? XTextWidth(fontinfo, prompt, (int)strlen(prompt)) : 8 * (int)strlen(prompt));
+    ui->draw_text(COL_FG, xdraw, ydraw, prompt, (int)strlen(prompt));
+    int ix = xdraw + ui->text_width(prompt, (int)strlen(prompt));
     // Draw multi-line input after the prompt: first line continues from ix, subsequent lines from xdraw
     int line_index = 0; int caret_line = 0; int caret_col = 0;
     // Compute caret line/col
@@ -208,154 +345,239 @@ void draw() {
         char *nl = memchr(t->inputbuf + off, '\n', t->inputlen - off);
         size_t len = nl ? (size_t)(nl - (t->inputbuf + off)) : (t->inputlen - off);
         if (line_index == 0) {
-            if (len > 0) XDrawString(dpy, win, gc, ix, ydraw, t->inputbuf + off, (int)len);
+            if (len > 0) ui->draw_text(COL_FG, ix, ydraw, t->inputbuf + off, (int)len);
         } else {
-            if (len > 0) XDrawString(dpy, win, gc, xdraw, ydraw, t->inputbuf + off, (int)len);
+            if (len > 0) ui->draw_text(COL_FG, xdraw, ydraw, t->inputbuf + off, (int)len);
         }
         ydraw += line_height; line_index++;
         if (!nl) break; else off = (size_t)((nl + 1) - t->inputbuf);
-        // draw empty line if consecutive '\n'
-        if (off <= t->inputlen && (nl && (off == (size_t)((nl + 1) - t->inputbuf)))) {
-            // no-op; handled by loop naturally
-        }
     }
     // Caret position based on caret_line/col
     int caret_x;
     // Base Y where the caret line sits: if no input lines drawn, stay on prompt baseline
     int caret_base_y = (line_index == 0) ? ydraw : (ydraw - line_height);
     if (caret_line == 0) {
-        if (fontinfo) caret_x = ix + XTextWidth(fontinfo, t->inputbuf, (int)caret_col);
-        else caret_x = ix + 8 * caret_col;
-        int cy = caret_base_y;
-        XSetForeground(dpy, gc, col_accent);
-        XDrawLine(dpy, win, gc, caret_x, cy + 2, caret_x, cy - line_height + 4);
+        caret_x = ix + ui->text_width(t->inputbuf, caret_col);
     } else {
         // compute x from start for the segment of current line
         size_t start = 0; int l = caret_line;
         for (size_t i=0;i<t->cursor_idx && l>0; i++) { if (t->inputbuf[i]=='\n') { start = i+1; l--; } }
-        if (fontinfo) caret_x = xdraw + XTextWidth(fontinfo, t->inputbuf + start, (int)caret_col);
-        else caret_x = xdraw + 8 * caret_col;
-        int cy = caret_base_y;
-        XSetForeground(dpy, gc, col_accent);
-        XDrawLine(dpy, win, gc, caret_x, cy + 2, caret_x, cy - line_height + 4);
+        caret_x = xdraw + ui->text_width(t->inputbuf + start, caret_col);
     }
-    XFlush(dpy);
+    ui->draw_line(COL_ACCENT, caret_x, caret_base_y + 2, caret_x, caret_base_y - line_height + 4);
+}
+
+static void paint(void) {
+    // Text area origin
+    int text_origin_x = 10;
+    int text_origin_y = tab_bar_h + 16;
+    Tab *t = &tabs[active_tab];
+    int available_lines = (win_height - text_origin_y) / line_height - 1; // keep one line for prompt
+    if (available_lines < 0) available_lines = 0;
+    int total_lines = (int)sb_line_count(&t->sb);
+    int max_offset = total_lines > available_lines ? (total_lines - available_lines) : 0;
+    if (scroll_offset > max_offset) scroll_offset = max_offset;
+    if (scroll_offset < 0) scroll_offset = 0;
+    int start_line = total_lines - available_lines - scroll_offset;
+    if (start_line < 0) start_line = 0;
+    int nlines = total_lines - start_line < available_lines ? total_lines - start_line : available_lines;
+    int prompt_y = text_origin_y + nlines * line_height;
+    int panes = multiwatch_panes(&t->cap);
+    if (panes) {
+        // the panes take the whole text area
+        nlines = available_lines;
+        prompt_y = text_origin_y + nlines * line_height;
+    }
+    // the input area follows the text while the screen is not yet full
+    if (prompt_y != painted_prompt_y) damage |= DAMAGE_TEXT | DAMAGE_INPUT;
+    // a full repaint (new back buffer, tab switch) cannot reuse old pixels
+    if ((damage & DAMAGE_ALL) == DAMAGE_ALL) painted_tab = painted_panes_tab = -1;
+    if (!panes) painted_panes_tab = -1;
+
+    blit_y0 = win_height; blit_y1 = 0;
+    if (damage & DAMAGE_TABBAR) paint_tabbar();
+    if ((damage & DAMAGE_TEXT) && panes) paint_panes(t, panes, nlines, text_origin_x, text_origin_y, prompt_y);
+    else if (damage & DAMAGE_TEXT) paint_text(t, start_line, nlines, text_origin_x, text_origin_y, prompt_y);
+    if (damage & DAMAGE_INPUT) paint_input(t, text_origin_x, prompt_y);
+    painted_prompt_y = prompt_y;
+    unsigned painted = damage;
+    damage = 0;
+    ui->present(0, blit_y0, win_width, blit_y1 > blit_y0 ? blit_y1 - blit_y0 : 0);
+    // first frame with the running command's output on it
+    if ((painted & DAMAGE_TEXT) && t->cap.tl.t[TRACE_FIRST_BYTE]) {
+        trace_mark(&t->cap.tl, TRACE_FIRST_PAINT);
+        trace_settle(&t->cap.tl);
+    }
+}
+
+int paint_if_due(void) {
+    if (!damage) return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long since = (long long)(now.tv_sec - last_paint.tv_sec) * 1000000000LL + (now.tv_nsec - last_paint.tv_nsec);
+    if (since < FRAME_NS) return (int)((FRAME_NS - since + 999999) / 1000000);
+    paint();
+    last_paint = now;
+    return -1;
+}
+
+// Tab whose command line is being resumed from the main loop; output and
+// current_capture() go there instead of the active tab (-1 = active tab)
+static int resumed_tab = -1;
+
+static int output_tab(void) {
+    return resumed_tab >= 0 ? resumed_tab : active_tab;
 }
 
 void append_output(const char *s, size_t n) {
     if (n == 0) return;
-    Tab *t = &tabs[active_tab];
-    if (n > BUF_SIZE - t->textlen) n = BUF_SIZE - t->textlen;
-    memcpy(t->textbuf + t->textlen, s, n);
-    t->textlen += n;
+    vt_write(&tabs[output_tab()].vt, &tabs[output_tab()].sb, s, n);
     // if at bottom (scroll_offset==0), remain at bottom as new output arrives
+    if (output_tab() == active_tab) invalidate(DAMAGE_TEXT);
 }
 
 void append_output_str(const char *s) {
     append_output(s, strlen(s));
 }
 
-// nonblocking pump of child output and child exit reaping
-static void pump_child_io() {
-    int progress = 0;
-    char buf[1024];
-    // read stdout
-    if (cap_out_fd != -1) {
-        for (;;) {
-            ssize_t r = read(cap_out_fd, buf, sizeof(buf));
-            if (r > 0) { append_output(buf, (size_t)r); progress = 1; }
-            else if (r == 0) { close(cap_out_fd); cap_out_fd = -1; break; }
-            else { if (errno == EAGAIN || errno == EWOULDBLOCK) break; else { close(cap_out_fd); cap_out_fd=-1; break; } }
-        }
+Capture *current_capture(void) {
+    return &tabs[output_tab()].cap;
+}
+
+void capture_invalidate(Capture *c, unsigned regions) {
+    if (c == &tabs[active_tab].cap) invalidate(regions);
+}
+
+void capture_output(Capture *c, const char *s, size_t n) {
+    for (int i = 0; i < MAX_TABS; i++) {
+        if (&tabs[i].cap != c || n == 0) continue;
+        vt_write(&tabs[i].vt, &tabs[i].sb, s, n);
+        if (i == active_tab) invalidate(DAMAGE_TEXT);
+    }
+}
+
+void capture_marked(Capture *c, const char *s, size_t n) {
+    for (int i = 0; i < MAX_TABS; i++) {
+        if (&tabs[i].cap != c || n == 0) continue;
+        vt_write_marked(&tabs[i].vt, &tabs[i].sb, s, n);
+        if (i == active_tab) invalidate(DAMAGE_TEXT);
     }
-    // read stderr
-    if (cap_err_fd != -1) {
-        for (;;) {
-            ssize_t r = read(cap_err_fd, buf, sizeof(buf));
-            if (r > 0) { append_output(buf, (size_t)r); progress = 1; }
-            else if (r == 0) { close(cap_err_fd); cap_err_fd = -1; break; }
-            else { if (errno == EAGAIN || errno == EWOULDBLOCK) break; else { close(cap_err_fd); cap_err_fd=-1; break; } }
+}
+
+// Bytes read from one pipe per wakeup; the rest waits for the next loop
+// iteration so a noisy child cannot starve X event handling.
+#define PUMP_BUDGET (1024 * 1024)
+
+// Drain one capture pipe straight into tab i's scrollback pages with readv(),
+// through the tab's VT filter; closes it on EOF or error
+static void pump_fd(int i, int *fd) {
+    Scrollback *sb = &tabs[i].sb;
+    size_t budget = PUMP_BUDGET;
+    while (budget > 0) {
+        struct iovec iov[2];
+        int niov = sb_reserve(sb, iov);
+        size_t want = 0;
+        for (int k = 0; k < niov; k++) want += iov[k].iov_len;
+        ssize_t r = readv(*fd, iov, niov);
+        if (r > 0) {
+            vt_commit(&tabs[i].vt, sb, iov, niov, (size_t)r);
+            trace_mark(&tabs[i].cap.tl, TRACE_FIRST_BYTE);
+            if (i == active_tab) invalidate(DAMAGE_TEXT);
+            // a short read means the pipe is drained; skip the EAGAIN round trip
+            if ((size_t)r < want) break;
+            budget = (size_t)r < budget ? budget - (size_t)r : 0;
         }
+        else if (r == 0) { close(*fd); *fd = -1; break; }
+        else { if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break; else { close(*fd); *fd=-1; break; } }
     }
-    // reap children non-blocking
-    if (cap_active) {
+}
+
+// nonblocking pump of every tab's child output; exits arrive through
+// reap_children(), which clears the pids of a capture's stages
+static void pump_child_io() {
+    for (int i=0;i<MAX_TABS;i++) {
+        Capture *c = &tabs[i].cap;
+        // a multiWatch session frees the tab itself
+        if (!c->active || c->watch) continue;
+        if (c->out_fd != -1) pump_fd(i, &c->out_fd);
+        if (c->err_fd != -1) pump_fd(i, &c->err_fd);
         int alive = 0;
-        for (int i=0;i<cap_nstages;i++) if (cap_pids[i] > 0) {
-            int st; pid_t w = waitpid(cap_pids[i], &st, WNOHANG);
-            if (w == 0) alive = 1; else if (w == cap_pids[i]) cap_pids[i] = 0; else alive = 1;
-        }
-        if (!alive && cap_out_fd == -1 && cap_err_fd == -1) {
-            cap_active = 0; fg_child = -1;
-            // Show completion message for commands that produce no output
-            progress = 1;  // Force redraw to show prompt
+        for (int k=0;k<c->nstages;k++) if (c->pids[k] > 0) alive = 1;
+        if (!alive && c->out_fd == -1 && c->err_fd == -1) {
+            // next pipeline of the command line, if any
+            resumed_tab = i;
+            int more = plan_continue(c);
+            resumed_tab = -1;
+            if (i == active_tab) refresh_cwd();
+            if (more) continue;
+            c->active = 0; c->fg_child = -1;
+            trace_mark(&c->tl, TRACE_EXIT);
+            trace_settle(&c->tl);
+            // prompt drops its [running] indicator
+            if (i == active_tab) invalidate(DAMAGE_INPUT);
         }
     }
-    if (progress) draw();
 }
 
-/* history functions moved to src/history.c */
+// Detach a tab from its foreground job, closing the capture pipes
+static void capture_release(Capture *c) {
+    if (c->out_fd != -1) { close(c->out_fd); c->out_fd = -1; }
+    if (c->err_fd != -1) { close(c->err_fd); c->err_fd = -1; }
+    plan_abort(c);
+    c->active = 0;
+    c->fg_child = -1;
+    trace_mark(&c->tl, TRACE_EXIT);
+    trace_settle(&c->tl);
+}
 
-/* print_history_command moved to src/history.c */
+// Reset tab i to an empty session, hanging up any job still running in it
+static void tab_reset(int i) {
+    Capture *c = &tabs[i].cap;
+    if (c->active) {
+        if (c->pgid > 0) { kill(-c->pgid, SIGHUP); kill(-c->pgid, SIGCONT); }
+        multiwatch_detach(c);
+        capture_release(c);
+    }
+    jobs_hangup(c);
+    sb_clear(&tabs[i].sb);
+    tabs[i].vt = (Vt){0};
+    tabs[i].inputlen = 0; tabs[i].cursor_idx = 0;
+}
 
-/* parser helpers now in src/exec.c */
+/* history functions moved to history.c */
+
+/* print_history_command moved to history.c */
+
+/* parser helpers now in exec.c */
 
 void clear_screen() {
-    Tab *t = &tabs[active_tab];
-    t->textlen = 0;
-    t->textbuf[0] = '\0';
+    sb_clear(&tabs[output_tab()].sb);
+    tabs[output_tab()].vt = (Vt){0};
+    draw();
 }
 
 static int is_whitespace(char c) { return c==' '||c=='\t' || c=='\n'; }
 
 // Replace embedded newlines with spaces and trim/collapse whitespace so multiline input
 // executes as a single command line.
-static void normalize_command(char *s) {
-    // map CR/LF to space
-    for (char *p = s; *p; ++p) {
-        if (*p == '\n' || *p == '\r') *p = ' ';
-    }
-    // trim leading/trailing spaces and collapse multiple spaces
-    size_t r = 0, w = 0; int in_space = 0;
-    // skip leading spaces
-    while (s[r] && (s[r] == ' ' || s[r] == '\t')) r++;
-    for (; s[r]; ++r) {
-        if (s[r] == ' ' || s[r] == '\t') {
-            if (!in_space) { s[w++] = ' '; in_space = 1; }
-        } else {
-            s[w++] = s[r]; in_space = 0;
-        }
-    }
-    // trim trailing space
-    if (w>0 && s[w-1] == ' ') w--;
-    s[w] = '\0';
-}
-
-/* parse_args moved to src/exec.c */
+/* parse_args moved to exec.c */
 
-/* split_pipes moved to src/exec.c */
+/* split_pipes moved to exec.c */
 
-/* execute_pipeline moved to src/exec.c */
+/* execute_pipeline moved to exec.c */
 
 static void handle_ctrl_c() {
-    // Set interrupt flag for blocking operations (e.g., multiWatch)
-    interrupt_requested = 1;
-    
-    if (cap_active) {
-        // Kill all processes in the pipeline
-        for (int i = 0; i < cap_nstages; i++) {
-            if (cap_pids[i] > 0) {
-                kill(cap_pids[i], SIGINT);
-                cap_pids[i] = 0;
-            }
-        }
-        // Close capture pipes
-        if (cap_out_fd != -1) { close(cap_out_fd); cap_out_fd = -1; }
-        if (cap_err_fd != -1) { close(cap_err_fd); cap_err_fd = -1; }
-        // Reset capture state
-        cap_active = 0;
-        fg_child = -1;
+    Capture *c = current_capture();
+    if (c->active) {
+        // Interrupt the whole pipeline (or multiWatch) and drop the rest of
+        // the line; the capture finishes as its processes exit
+        plan_abort(c);
+        if (c->pgid > 0) kill(-c->pgid, SIGINT);
+        // a stopped multiWatch only sees the interrupt once it runs
+        if (c->watch && c->pgid > 0) kill(-c->pgid, SIGCONT);
         append_output_str("^C\n");
-        draw();
+        if (c->watch) multiwatch_stop(c);
+        invalidate(DAMAGE_INPUT);
     } else {
         // No running command: clear input line and show ^C
         Tab *t = &tabs[active_tab];
@@ -364,479 +586,476 @@ static void handle_ctrl_c() {
             t->inputlen = 0;
             t->cursor_idx = 0;
             t->inputbuf[0] = '\0';
-            draw();
+            invalidate(DAMAGE_INPUT);
         }
     }
 }
 
 static void handle_ctrl_z() {
-    if (cap_active) {
-        // Find a free job slot
-        int job_idx = -1;
-        for (int i = 0; i < MAX_JOBS; i++) {
-            if (!bg_jobs[i].active) {
-                job_idx = i;
-                break;
-            }
-        }
-        
-        if (job_idx == -1) {
-            append_output_str("^Z\n[Too many background jobs]\n");
-            // Kill the process instead
-            for (int i = 0; i < cap_nstages; i++) {
-                if (cap_pids[i] > 0) kill(cap_pids[i], SIGKILL);
-            }
-        } else {
-            // Store job information
-            bg_jobs[job_idx].active = 1;
-            bg_jobs[job_idx].nprocs = cap_nstages;
-            for (int i = 0; i < cap_nstages; i++) {
-                bg_jobs[job_idx].pids[i] = cap_pids[i];
-            }
-            // Store command (get from last input)
-            Tab *t = &tabs[active_tab];
-            if (t->inputlen > 0 && t->inputlen < sizeof(bg_jobs[job_idx].command)) {
-                memcpy(bg_jobs[job_idx].command, t->inputbuf, t->inputlen);
-                bg_jobs[job_idx].command[t->inputlen] = '\0';
-            } else {
-                snprintf(bg_jobs[job_idx].command, sizeof(bg_jobs[job_idx].command), "(unknown)");
-            }
-            
-            bg_job_count++;
-            
-            // Send SIGCONT to resume processes in background
-            // (They were never stopped, so this just ensures they continue)
-            for (int i = 0; i < cap_nstages; i++) {
-                if (cap_pids[i] > 0) {
-                    kill(cap_pids[i], SIGCONT);
-                }
-            }
-            
-            char msg[128];
-            snprintf(msg, sizeof(msg), "^Z\n[%d] %d\n", job_idx + 1, bg_jobs[job_idx].pids[cap_nstages-1]);
-            append_output_str(msg);
-        }
-        
-        // Close capture pipes (detach from process output)
-        if (cap_out_fd != -1) { close(cap_out_fd); cap_out_fd = -1; }
-        if (cap_err_fd != -1) { close(cap_err_fd); cap_err_fd = -1; }
-        // Reset capture state (process moves to background)
-        cap_active = 0;
-        fg_child = -1;
-        draw();
+    Capture *c = current_capture();
+    if (c->active) {
+        // Stop the pipeline; the reaper sees the stop and moves it to the
+        // job table, from where fg or bg resumes it. multiWatch stays in
+        // the tab and toggles between stopped and running.
+        append_output_str("^Z\n");
+        if (c->watch) multiwatch_pause(c);
+        else if (c->pgid > 0) kill(-c->pgid, SIGTSTP);
+        invalidate(DAMAGE_INPUT);
     } else {
         // No running command
         Tab *t = &tabs[active_tab];
         if (t->inputlen > 0) {
             append_output_str("^Z\n");
-            draw();
+            invalidate(DAMAGE_INPUT);
         }
     }
 }
 
+// Insert n bytes at the cursor of tab t
+static void insert_at_cursor(Tab *t, const char *s, size_t n) {
+    if (t->inputlen + n >= MAX_INPUT - 1) return;
+    memmove(t->inputbuf + t->cursor_idx + n, t->inputbuf + t->cursor_idx, t->inputlen - t->cursor_idx);
+    memcpy(t->inputbuf + t->cursor_idx, s, n);
+    t->inputlen += n;
+    t->cursor_idx += n;
+    t->inputbuf[t->inputlen] = '\0';
+}
+
 static void complete_tab() {
     Tab *t = &tabs[active_tab];
-    
+    completion_wait = 0;
+
     // Find current token before cursor
     size_t start = t->cursor_idx;
     while (start > 0 && t->inputbuf[start-1] != ' ' && t->inputbuf[start-1] != '\t') {
         start--;
     }
-    
-    char prefix[256] = "";
     size_t plen = t->cursor_idx - start;
-    if (plen >= sizeof(prefix)) return;
-    memcpy(prefix, t->inputbuf + start, plen);
-    prefix[plen] = '\0';
-    
     // If prefix is empty, don't complete
-    if (plen == 0) return;
-    
-    // Scan directory for matches
-    DIR *d = opendir(".");
-    if (!d) return;
-    
-    char matches[512][256];
-    int mcount = 0;
-    struct dirent *de;
-    
-    while ((de = readdir(d)) != NULL) {
-        // Skip . and ..
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-            continue;
-        }
-        
-        if (strncmp(de->d_name, prefix, plen) == 0) {
-            if (mcount < 512) {
-                snprintf(matches[mcount], sizeof(matches[mcount]), "%s", de->d_name);
-                mcount++;
-            }
-        }
+    if (plen == 0 || plen >= 256) return;
+
+    // Split "dir/name" so path components complete inside dir
+    char dir[256] = ".", prefix[256];
+    size_t dlen = plen;
+    while (dlen > 0 && t->inputbuf[start + dlen - 1] != '/') dlen--;
+    if (dlen > 0) { memcpy(dir, t->inputbuf + start, dlen); dir[dlen] = '\0'; }
+    memcpy(prefix, t->inputbuf + start + dlen, plen - dlen);
+    prefix[plen - dlen] = '\0';
+    size_t blen = plen - dlen;
+
+    // The first word of a command completes to programs on $PATH
+    size_t k = start;
+    while (k > 0 && (t->inputbuf[k-1] == ' ' || t->inputbuf[k-1] == '\t')) k--;
+    int command = dlen == 0 && (k == 0 || strchr("|;&(", t->inputbuf[k-1]) != NULL);
+
+    const char *matches[COMPLETE_MAX];
+    int mcount = complete_find(command ? NULL : dir, prefix, matches, COMPLETE_MAX);
+    if (mcount < 0) {
+        // still scanning off-thread; retried from the event loop when done
+        completion_wait = 1; completion_wait_tab = active_tab;
+        completion_wait_len = t->inputlen; completion_wait_cursor = t->cursor_idx;
+        return;
     }
-    closedir(d);
-    
+
     // No matches - do nothing
     if (mcount == 0) {
         return;
     }
-    
+
     // Single match - complete fully
     if (mcount == 1) {
-        size_t add = strlen(matches[0]) - plen;
-        if (t->inputlen + add < MAX_INPUT - 1) {
-            // Insert the rest of the filename
-            memmove(t->inputbuf + t->cursor_idx + add, 
-                    t->inputbuf + t->cursor_idx, 
-                    t->inputlen - t->cursor_idx);
-            memcpy(t->inputbuf + start + plen, matches[0] + plen, add);
-            t->inputlen += add;
-            t->cursor_idx += add;
-            t->inputbuf[t->inputlen] = '\0';
-        }
+        insert_at_cursor(t, matches[0] + blen, strlen(matches[0]) - blen);
         return;
     }
-    
-    // Multiple matches - find longest common prefix
-    char lcp[256];
-    strncpy(lcp, matches[0], sizeof(lcp));
-    lcp[sizeof(lcp)-1] = '\0';
-    
+
+    // Multiple matches - complete to the longest common prefix
+    size_t lcp = strlen(matches[0]);
     for (int i = 1; i < mcount; i++) {
-        int j = 0;
-        while (lcp[j] && matches[i][j] && lcp[j] == matches[i][j]) {
-            j++;
-        }
-        lcp[j] = '\0';
+        size_t j = 0;
+        while (j < lcp && matches[i][j] && matches[i][j] == matches[0][j]) j++;
+        lcp = j;
     }
-    
-    // If longest common prefix is longer than current prefix, complete to it
-    if (strlen(lcp) > plen) {
-        size_t add = strlen(lcp) - plen;
-        if (t->inputlen + add < MAX_INPUT - 1) {
-            memmove(t->inputbuf + t->cursor_idx + add,
-                    t->inputbuf + t->cursor_idx,
-                    t->inputlen - t->cursor_idx);
-            memcpy(t->inputbuf + start + plen, lcp + plen, add);
-            t->inputlen += add;
-            t->cursor_idx += add;
-            t->inputbuf[t->inputlen] = '\0';
-        }
-        // After completing to LCP, check if still multiple matches
-        // If yes, show numbered list
-        if (mcount > 1) {
-            append_output_str("\nMultiple matches:\n");
-            for (int i = 0; i < mcount; i++) {
-                char num[32];
-                snprintf(num, sizeof(num), "%d. %s\n", i + 1, matches[i]);
-                append_output_str(num);
-            }
-            append_output_str("Enter number to select: ");
-            
-            // Save matches for selection
-            completion_mode = 1;
-            completion_count = mcount;
-            completion_token_start = start;
-            for (int i = 0; i < mcount; i++) {
-                strncpy(completion_matches[i], matches[i], sizeof(completion_matches[i]));
-            }
-        }
-    } else {
-        // LCP is same as prefix, show numbered list immediately
-        append_output_str("\nMultiple matches:\n");
-        for (int i = 0; i < mcount; i++) {
-            char num[32];
-            snprintf(num, sizeof(num), "%d. %s\n", i + 1, matches[i]);
-            append_output_str(num);
-        }
-        append_output_str("Enter number to select: ");
-        
-        // Save matches for selection
-        completion_mode = 1;
-        completion_count = mcount;
-        completion_token_start = start;
-        for (int i = 0; i < mcount; i++) {
-            strncpy(completion_matches[i], matches[i], sizeof(completion_matches[i]));
-        }
+    if (lcp > blen) insert_at_cursor(t, matches[0] + blen, lcp - blen);
+
+    // then show a numbered list to pick from
+    append_output_str("\nMultiple matches:\n");
+    for (int i = 0; i < mcount; i++) {
+        char num[32];
+        snprintf(num, sizeof(num), "%d. ", i + 1);
+        append_output_str(num); append_output_str(matches[i]); append_output_str("\n");
     }
+    append_output_str("Enter number to select: ");
+
+    // Save matches for selection
+    completion_mode = 1;
+    completion_count = mcount;
+    completion_token_start = start + dlen;
+    for (int i = 0; i < mcount; i++) {
+        snprintf(completion_matches[i], sizeof(completion_matches[i]), "%s", matches[i]);
+    }
+}
+
+// Scrollback caps from the environment (<n>[K|M]), falling back to the compiled defaults
+static size_t scrollback_cap(const char *name, size_t def) {
+    const char *env = getenv(name);
+    if (!env || !*env) return def;
+    char *end;
+    unsigned long long v = strtoull(env, &end, 10);
+    if (*end == 'K' || *end == 'k') v <<= 10;
+    else if (*end == 'M' || *end == 'm') v <<= 20;
+    return v ? (size_t)v : def;
 }
 
 static void run_command(char *cmdline) {
     if (cmdline == NULL || *cmdline == '\0') return;
+    // a builtin typed while a job runs does not replace the job's timeline
+    Capture *cap = current_capture();
+    if (!cap->active) trace_begin(&cap->tl, active_tab, cmdline);
 
-    // Clear interrupt flag from previous Ctrl+C
-    interrupt_requested = 0;
-
-    // background?
-    int background = 0;
-    // normalize multiline to single line
-    normalize_command(cmdline);
-    size_t L = strlen(cmdline);
-    while (L>0 && is_whitespace(cmdline[L-1])) cmdline[--L]='\0';
-    if (L>0 && cmdline[L-1]=='&') { background=1; cmdline[L-1]='\0'; }
-
-    // multiWatch?
+    // multiWatch? (everything else goes through the parser)
+    while (is_whitespace(*cmdline)) cmdline++;
     if (strncmp(cmdline, "multiWatch", 10)==0) {
         char *p = cmdline+10; while (is_whitespace(*p)) p++;
-        multiwatch_run(p);
+        if (multiwatch_start(cap, p) < 0) {
+            trace_mark(&cap->tl, TRACE_EXIT);
+            trace_settle(&cap->tl);
+        }
         return;
     }
 
-    execute_pipeline(cmdline, background);
+    execute_pipeline(cmdline);
 }
 
-int main() {
-    setlocale(LC_ALL, "");
-    dpy = XOpenDisplay(NULL);
-    dpy_global = dpy;  // export for multiWatch
-    if (!dpy) die("XOpenDisplay");
-    screen = DefaultScreen(dpy);
-    win = XCreateSimpleWindow(dpy, RootWindow(dpy, screen), 100, 100, 900, 600, 1,
-                              BlackPixel(dpy, screen), WhitePixel(dpy, screen));
-    XStoreName(dpy, win, "MyTerm");
-    XSelectInput(dpy, win, ExposureMask | KeyPressMask | ButtonPressMask | StructureNotifyMask);
-    XMapWindow(dpy, win);
-    gc = XCreateGC(dpy, win, 0, NULL);
-    XSetForeground(dpy, gc, BlackPixel(dpy, screen));
-    // Colors
-    cmap = DefaultColormap(dpy, screen);
-    XColor scr, exact;
-    if (XAllocNamedColor(dpy, cmap, "#121212", &scr, &exact)) col_bg = scr.pixel; else col_bg = BlackPixel(dpy, screen);
-    if (XAllocNamedColor(dpy, cmap, "#E6EDF3", &scr, &exact)) col_fg = scr.pixel; else col_fg = WhitePixel(dpy, screen);
-    if (XAllocNamedColor(dpy, cmap, "#1F2937", &scr, &exact)) col_tab_active = scr.pixel; else col_tab_active = col_bg;
-    if (XAllocNamedColor(dpy, cmap, "#0B0F14", &scr, &exact)) col_tab_inactive = scr.pixel; else col_tab_inactive = col_bg;
-    if (XAllocNamedColor(dpy, cmap, "#10B981", &scr, &exact)) col_accent = scr.pixel; else col_accent = col_fg;
-    // Load a fixed-width font for proper caret placement
-    fontinfo = XLoadQueryFont(dpy, "fixed");
-    if (fontinfo) {
-        XSetFont(dpy, gc, fontinfo->fid);
-        line_height = fontinfo->ascent + fontinfo->descent + 2;
-    }
-
-    // init tabs
-    for (int i=0;i<MAX_TABS;i++){ tabs[i].textlen=0; tabs[i].inputlen=0; tabs[i].cursor_idx=0; tab_used[i]=0; }
-    tab_used[0] = 1; // show Tab 1 by default
-    active_tab = 0;
-    // history
-    history_init();
-    history_load();
-    append_output_str("Welcome to MyTerm\n");
-
-    for (;;) {
-        // 1) Pump child IO so output continues streaming
-        pump_child_io();
+// Apply one backend event to the UI state; painting happens later in paint_if_due()
+void ui_handle_event(const UiEvent *ev) {
+    if (ev->type == EV_EXPOSE) {
+        // the back buffer still holds the last frame
+        ui->present(ev->x, ev->y, ev->width, ev->height);
+    } else if (ev->type == EV_RESIZE) {
+        if (ev->width != win_width || ev->height != win_height) resize_backbuf(ev->width, ev->height);
+    } else if (ev->type == EV_QUIT) {
+        quitting = 1;
+    } else if (ev->type == EV_KEY) {
+        Tab *t = &tabs[active_tab];
 
-        // 2) Handle all pending X events without blocking
-        while (XPending(dpy)) {
-            XEvent ev;
-            XNextEvent(dpy, &ev);
-            if (ev.type == Expose) {
-                draw();
-            } else if (ev.type == ConfigureNotify) {
-                win_width = ev.xconfigure.width; win_height = ev.xconfigure.height; draw();
-            } else if (ev.type == KeyPress) {
-                KeySym keysym;
-                char buf[32];
-                int len = XLookupString(&ev.xkey, buf, sizeof(buf), &keysym, NULL);
-                Tab *t = &tabs[active_tab];
-
-                // Handle completion mode (number selection)
-                if (completion_mode) {
-                    if (keysym == XK_Return || keysym == XK_Escape) {
-                        // Cancel completion
-                        completion_mode = 0;
-                        append_output_str("\n");
-                        draw();
-                    } else if (len > 0 && buf[0] >= '1' && buf[0] <= '9') {
-                        int selection = buf[0] - '0';
-                        if (selection > 0 && selection <= completion_count) {
-                            // Replace token with selected file
-                            char *selected = completion_matches[selection - 1];
-                            
-                            // Find end of current token
-                            size_t end = completion_token_start;
-                            while (end < t->inputlen && t->inputbuf[end] != ' ' && t->inputbuf[end] != '\t') {
-                                end++;
-                            }
-                            
-                            // Calculate new length
-                            size_t token_len = end - completion_token_start;
-                            size_t new_len = strlen(selected);
-                            
-                            if (t->inputlen - token_len + new_len < MAX_INPUT - 1) {
-                                // Remove old token and insert new one
-                                memmove(t->inputbuf + completion_token_start + new_len,
-                                        t->inputbuf + end,
-                                        t->inputlen - end);
-                                memcpy(t->inputbuf + completion_token_start, selected, new_len);
-                                t->inputlen = t->inputlen - token_len + new_len;
-                                t->cursor_idx = completion_token_start + new_len;
-                                t->inputbuf[t->inputlen] = '\0';
-                                
-                                char msg[300];
-                                // Truncate filename if too long to fit in message buffer
-                                char safe_name[256];
-                                strncpy(safe_name, selected, sizeof(safe_name) - 1);
-                                safe_name[sizeof(safe_name) - 1] = '\0';
-                                snprintf(msg, sizeof(msg), "\nSelected: %s\n", safe_name);
-                                append_output_str(msg);
-                            }
-                        } else {
-                            append_output_str("\nInvalid selection\n");
-                        }
-                        completion_mode = 0;
-                        draw();
+        // Handle completion mode (number selection)
+        if (completion_mode) {
+            if (ev->key == KEY_RETURN || ev->key == KEY_ESCAPE) {
+                // Cancel completion
+                completion_mode = 0;
+                append_output_str("\n");
+                invalidate(DAMAGE_INPUT);
+            } else if (ev->len > 0 && ev->text[0] >= '1' && ev->text[0] <= '9') {
+                int selection = ev->text[0] - '0';
+                if (selection > 0 && selection <= completion_count) {
+                    // Replace token with selected file
+                    char *selected = completion_matches[selection - 1];
+                    
+                    // Find end of current token
+                    size_t end = completion_token_start;
+                    while (end < t->inputlen && t->inputbuf[end] != ' ' && t->inputbuf[end] != '\t') {
+                        end++;
                     }
-                    continue;
-                }
-                
-                if (search_mode) {
-                    if (keysym == XK_Return) {
-                        searchbuf[searchlen]='\0';
-                        append_output_str("Search: "); append_output_str(searchbuf); append_output_str("\n");
-                        history_search_and_print(searchbuf);
-                        searchlen=0; searchbuf[0]='\0'; search_mode=0; draw();
-                    } else if (keysym == XK_BackSpace) {
-                        if (searchlen>0) { searchlen--; searchbuf[searchlen]='\0'; }
-                        draw();
-                    } else if (len>0 && searchlen+len<MAX_INPUT-1) {
-                        memcpy(searchbuf+searchlen, buf, (size_t)len); searchlen+=len; searchbuf[searchlen]='\0';
-                        draw();
+                    
+                    // Calculate new length
+                    size_t token_len = end - completion_token_start;
+                    size_t new_len = strlen(selected);
+                    
+                    if (t->inputlen - token_len + new_len < MAX_INPUT - 1) {
+                        // Remove old token and insert new one
+                        memmove(t->inputbuf + completion_token_start + new_len,
+                                t->inputbuf + end,
+                                t->inputlen - end);
+                        memcpy(t->inputbuf + completion_token_start, selected, new_len);
+                        t->inputlen = t->inputlen - token_len + new_len;
+                        t->cursor_idx = completion_token_start + new_len;
+                        t->inputbuf[t->inputlen] = '\0';
+                        
+                        char msg[300];
+                        // Truncate filename if too long to fit in message buffer
+                        char safe_name[256];
+                        strncpy(safe_name, selected, sizeof(safe_name) - 1);
+                        safe_name[sizeof(safe_name) - 1] = '\0';
+                        snprintf(msg, sizeof(msg), "\nSelected: %s\n", safe_name);
+                        append_output_str(msg);
                     }
-                    continue;
+                } else {
+                    append_output_str("\nInvalid selection\n");
                 }
+                completion_mode = 0;
+                invalidate(DAMAGE_INPUT);
+            }
+            return;
+        }
+        
+        if (search_mode) {
+            if (ev->key == KEY_RETURN) {
+                searchbuf[searchlen]='\0';
+                append_output_str("Search: "); append_output_str(searchbuf); append_output_str("\n");
+                history_search_and_print(searchbuf);
+                searchlen=0; searchbuf[0]='\0'; search_mode=0; invalidate(DAMAGE_INPUT);
+            } else if (ev->key == KEY_ESCAPE) {
+                searchlen=0; searchbuf[0]='\0'; search_mode=0; invalidate(DAMAGE_INPUT);
+            } else if ((ev->mods & MOD_CTRL) && ev->key == 'r') {
+                // next older match
+                if (search_hit[0] && search_pos > 0) {
+                    search_pos--; search_update();
+                    if (search_failed) search_pos++;   // stay on the last match
+                }
+            } else if (ev->key == KEY_BACKSPACE) {
+                if (searchlen>0) { searchlen--; searchbuf[searchlen]='\0'; }
+                search_pos = -1; search_update();
+            } else if (ev->len>0 && !(ev->mods & MOD_CTRL) && searchlen+ev->len<MAX_INPUT-1) {
+                // a longer term can only match at or before the current hit
+                memcpy(searchbuf+searchlen, ev->text, (size_t)ev->len); searchlen+=ev->len; searchbuf[searchlen]='\0';
+                search_update();
+            }
+            return;
+        }
 
-                if ((ev.xkey.state & ControlMask) && (keysym == XK_c || keysym==XK_C)) {
-                    handle_ctrl_c();
-                    draw();
-                } else if ((ev.xkey.state & ControlMask) && (keysym == XK_z || keysym==XK_Z)) {
-                    handle_ctrl_z();
-                    draw();
-                } else if ((ev.xkey.state & ControlMask) && (keysym == XK_t || keysym==XK_T)) {
-                    // new tab (Ctrl+T)
-                    int nt = -1;
-                    for (int i=0;i<MAX_TABS;i++) if (!tab_used[i]) { nt=i; break; }
-                    if (nt != -1) {
-                        tabs[nt].textlen=0; tabs[nt].inputlen=0; tabs[nt].cursor_idx=0; tab_used[nt]=1; active_tab=nt;
-                    }
-                    draw();
-                } else if ((ev.xkey.state & ControlMask) && (keysym == XK_R || keysym == XK_r)) {
-                    // Ctrl+R search
-                    search_mode = 1; searchlen=0; searchbuf[0]='\0'; append_output_str("Enter search term: "); draw();
-                } else if ((ev.xkey.state & ControlMask) && keysym == XK_a) {
-                    t->cursor_idx = 0; draw();
-                } else if ((ev.xkey.state & ControlMask) && keysym == XK_e) {
-                    t->cursor_idx = t->inputlen; draw();
-                } else if (keysym == XK_Tab) {
-                    complete_tab(); draw();
-                } else if (keysym == XK_Left) {
-                    if (t->cursor_idx>0) {
-                        t->cursor_idx--;
-                    }
-                    draw();
-                } else if (keysym == XK_Right) {
-                    if (t->cursor_idx<t->inputlen) {
-                        t->cursor_idx++;
-                    }
-                    draw();
-                } else if (keysym == XK_Prior && !(ev.xkey.state & ControlMask)) {
-                    scroll_offset += 3; draw();
-                } else if (keysym == XK_Next && !(ev.xkey.state & ControlMask)) {
-                    scroll_offset -= 3; if (scroll_offset < 0) scroll_offset = 0; draw();
-                } else if ((ev.xkey.state & ControlMask) && keysym == XK_Prior) { // Ctrl+PageUp -> prev tab
-                    for (int k=1;k<=MAX_TABS;k++) { int j=(active_tab - k + MAX_TABS)%MAX_TABS; if (tab_used[j]) { active_tab=j; break; } }
-                    draw();
-                } else if ((ev.xkey.state & ControlMask) && keysym == XK_Next) { // Ctrl+PageDown -> next tab
-                    for (int k=1;k<=MAX_TABS;k++) { int j=(active_tab + k)%MAX_TABS; if (tab_used[j]) { active_tab=j; break; } }
-                    draw();
-                } else if (keysym == XK_Return || keysym == XK_KP_Enter || (len>0 && (buf[0]=='\r' || buf[0]=='\n'))) {
-                    // Shift+Enter inserts a newline instead of executing
-                    if (ev.xkey.state & ShiftMask) {
-                        if (t->inputlen + 1 < MAX_INPUT-1) {
-                            memmove(t->inputbuf + t->cursor_idx + 1, t->inputbuf + t->cursor_idx, t->inputlen - t->cursor_idx);
-                            t->inputbuf[t->cursor_idx] = '\n';
-                            t->inputlen++; t->cursor_idx++;
-                            t->inputbuf[t->inputlen] = '\0';
-                        }
-                        draw();
-                        continue;
-                    }
+        if ((ev->mods & MOD_CTRL) && ev->key == 'c') {
+            handle_ctrl_c();
+            invalidate(DAMAGE_INPUT);
+        } else if ((ev->mods & MOD_CTRL) && ev->key == 'z') {
+            handle_ctrl_z();
+            invalidate(DAMAGE_INPUT);
+        } else if ((ev->mods & MOD_CTRL) && ev->key == 't') {
+            // new tab (Ctrl+T)
+            int nt = -1;
+            for (int i=0;i<MAX_TABS;i++) if (!tab_used[i]) { nt=i; break; }
+            if (nt != -1) {
+                tab_reset(nt); tab_used[nt]=1; active_tab=nt;
+            }
+            draw();
+        } else if ((ev->mods & MOD_CTRL) && ev->key == 'r') {
+            // Ctrl+R search
+            search_mode = 1; searchlen=0; searchbuf[0]='\0'; search_pos = -1; search_hit[0] = '\0'; invalidate(DAMAGE_INPUT);
+        } else if ((ev->mods & MOD_CTRL) && ev->key == 'a') {
+            t->cursor_idx = 0; invalidate(DAMAGE_INPUT);
+        } else if ((ev->mods & MOD_CTRL) && ev->key == 'e') {
+            t->cursor_idx = t->inputlen; invalidate(DAMAGE_INPUT);
+        } else if (ev->key == KEY_TAB) {
+            complete_tab(); invalidate(DAMAGE_INPUT);
+        } else if (ev->key == KEY_LEFT) {
+            if (t->cursor_idx>0) {
+                t->cursor_idx--;
+            }
+            invalidate(DAMAGE_INPUT);
+        } else if (ev->key == KEY_RIGHT) {
+            if (t->cursor_idx<t->inputlen) {
+                t->cursor_idx++;
+            }
+            invalidate(DAMAGE_INPUT);
+        } else if (ev->key == KEY_PRIOR && !(ev->mods & MOD_CTRL)) {
+            scroll_offset += 3; invalidate(DAMAGE_TEXT);
+        } else if (ev->key == KEY_NEXT && !(ev->mods & MOD_CTRL)) {
+            scroll_offset -= 3; if (scroll_offset < 0) scroll_offset = 0; invalidate(DAMAGE_TEXT);
+        } else if ((ev->mods & MOD_CTRL) && ev->key == KEY_PRIOR) { // Ctrl+PageUp -> prev tab
+            for (int k=1;k<=MAX_TABS;k++) { int j=(active_tab - k + MAX_TABS)%MAX_TABS; if (tab_used[j]) { active_tab=j; break; } }
+            draw();
+        } else if ((ev->mods & MOD_CTRL) && ev->key == KEY_NEXT) { // Ctrl+PageDown -> next tab
+            for (int k=1;k<=MAX_TABS;k++) { int j=(active_tab + k)%MAX_TABS; if (tab_used[j]) { active_tab=j; break; } }
+            draw();
+        } else if (ev->key == KEY_RETURN || ev->key == KEY_KP_ENTER || (ev->len>0 && (ev->text[0]=='\r' || ev->text[0]=='\n'))) {
+            // Shift+Enter inserts a newline instead of executing
+            if (ev->mods & MOD_SHIFT) {
+                if (t->inputlen + 1 < MAX_INPUT-1) {
+                    memmove(t->inputbuf + t->cursor_idx + 1, t->inputbuf + t->cursor_idx, t->inputlen - t->cursor_idx);
+                    t->inputbuf[t->cursor_idx] = '\n';
+                    t->inputlen++; t->cursor_idx++;
                     t->inputbuf[t->inputlen] = '\0';
-                    // Echo the prompt and command into the scrollback so it remains visible
-                    char cwd[512]; if (getcwd(cwd, sizeof(cwd)) == NULL) snprintf(cwd, sizeof(cwd), "?");
-                    append_output_str(cwd); append_output_str("> "); append_output_str(t->inputbuf); append_output_str("\n");
-                    draw();
-                    if (t->inputlen > 0) {
-                        add_history(t->inputbuf);
-                        history_save_append(t->inputbuf);
-                        memcpy(inputbuf, t->inputbuf, t->inputlen+1);
-                        inputlen = t->inputlen; cursor_idx = t->cursor_idx;
-                        run_command(t->inputbuf);
-                        scroll_offset = 0;
-                    }
-                    t->inputlen = 0; t->inputbuf[0] = '\0'; t->cursor_idx = 0; draw();
-                } else if (keysym == XK_BackSpace) {
-                    if (t->cursor_idx>0) {
-                        memmove(t->inputbuf+t->cursor_idx-1, t->inputbuf+t->cursor_idx, t->inputlen-t->cursor_idx);
-                        t->inputlen--; t->cursor_idx--; t->inputbuf[t->inputlen] = '\0';
-                    }
-                    draw();
-                } else if (len > 0) {
-                    if (t->inputlen + len < MAX_INPUT-1) {
-                        memmove(t->inputbuf+t->cursor_idx+len, t->inputbuf+t->cursor_idx, t->inputlen-t->cursor_idx);
-                        memcpy(t->inputbuf + t->cursor_idx, buf, (size_t)len);
-                        t->inputlen += (size_t)len; t->cursor_idx += (size_t)len; t->inputbuf[t->inputlen] = '\0';
-                    }
-                    draw();
                 }
-            } else if (ev.type == ButtonPress) {
-                int mx = ev.xbutton.x;
-                int my = ev.xbutton.y;
-                // Tab clicks (switch/close)
-                if (my >= 0 && my <= tab_bar_h) {
-                    // New tab button
-                    if (mx >= newtab_x && mx <= newtab_x + newtab_w) {
-                        int nt = -1;
-                        for (int i=0;i<MAX_TABS;i++) if (!tab_used[i]) { nt=i; break; }
-                        if (nt != -1) {
-                            tabs[nt].textlen=0; tabs[nt].inputlen=0; tabs[nt].cursor_idx=0; tab_used[nt]=1; active_tab=nt;
+                invalidate(DAMAGE_INPUT);
+                return;
+            }
+            t->inputbuf[t->inputlen] = '\0';
+            // Echo the prompt and command into the scrollback so it remains visible
+            append_output_str(prompt_cwd); append_output_str("> "); append_output_str(t->inputbuf); append_output_str("\n");
+            invalidate(DAMAGE_INPUT);
+            if (t->inputlen > 0) {
+                add_history(t->inputbuf);
+                history_save_append(t->inputbuf);
+                memcpy(inputbuf, t->inputbuf, t->inputlen+1);
+                inputlen = t->inputlen; cursor_idx = t->cursor_idx;
+                run_command(t->inputbuf);
+                refresh_cwd();
+                scroll_offset = 0;
+            }
+            t->inputlen = 0; t->inputbuf[0] = '\0'; t->cursor_idx = 0; invalidate(DAMAGE_INPUT);
+        } else if (ev->key == KEY_BACKSPACE) {
+            if (t->cursor_idx>0) {
+                memmove(t->inputbuf+t->cursor_idx-1, t->inputbuf+t->cursor_idx, t->inputlen-t->cursor_idx);
+                t->inputlen--; t->cursor_idx--; t->inputbuf[t->inputlen] = '\0';
+            }
+            invalidate(DAMAGE_INPUT);
+        } else if (ev->len > 0) {
+            if (t->inputlen + (size_t)ev->len < MAX_INPUT-1) {
+                memmove(t->inputbuf+t->cursor_idx+ev->len, t->inputbuf+t->cursor_idx, t->inputlen-t->cursor_idx);
+                memcpy(t->inputbuf + t->cursor_idx, ev->text, (size_t)ev->len);
+                t->inputlen += (size_t)ev->len; t->cursor_idx += (size_t)ev->len; t->inputbuf[t->inputlen] = '\0';
+            }
+            invalidate(DAMAGE_INPUT);
+        }
+    } else if (ev->type == EV_BUTTON) {
+        int mx = ev->x;
+        int my = ev->y;
+        // Tab clicks (switch/close)
+        if (my >= 0 && my <= tab_bar_h) {
+            // New tab button
+            if (mx >= newtab_x && mx <= newtab_x + newtab_w) {
+                int nt = -1;
+                for (int i=0;i<MAX_TABS;i++) if (!tab_used[i]) { nt=i; break; }
+                if (nt != -1) {
+                    tab_reset(nt); tab_used[nt]=1; active_tab=nt;
+                }
+                draw();
+                return;
+            }
+            for (int i=0;i<MAX_TABS;i++) {
+                int rx = tab_rect_x[i], rw = tab_rect_w[i];
+                if (rw <= 0) return;
+                if (mx >= rx && mx <= rx+rw) {
+                    // Check close box
+                    int cx = tab_close_x[i]; int closew = 14; int cy = 6; int ch = tab_bar_h - 12;
+                    if (mx >= cx && mx <= cx+closew && my >= cy && my <= cy+ch) {
+                        // close tab
+                        tab_reset(i); tab_used[i]=0;
+                        if (active_tab == i) {
+                            int nt = -1; for (int k=0;k<MAX_TABS;k++) if (tab_used[k]) { nt=k; break; }
+                            if (nt == -1) { tab_used[0]=1; nt=0; }
+                            active_tab = nt;
                         }
                         draw();
-                        continue;
-                    }
-                    for (int i=0;i<MAX_TABS;i++) {
-                        int rx = tab_rect_x[i], rw = tab_rect_w[i];
-                        if (rw <= 0) continue;
-                        if (mx >= rx && mx <= rx+rw) {
-                            // Check close box
-                            int cx = tab_close_x[i]; int closew = 14; int cy = 6; int ch = tab_bar_h - 12;
-                            if (mx >= cx && mx <= cx+closew && my >= cy && my <= cy+ch) {
-                                // close tab
-                                tabs[i].textlen = 0; tabs[i].inputlen = 0; tabs[i].cursor_idx = 0; tab_used[i]=0;
-                                if (active_tab == i) {
-                                    int nt = -1; for (int k=0;k<MAX_TABS;k++) if (tab_used[k]) { nt=k; break; }
-                                    if (nt == -1) { tab_used[0]=1; nt=0; }
-                                    active_tab = nt;
-                                }
-                                draw();
-                            } else {
-                                // activate tab
-                                if (tab_used[i]) { active_tab = i; draw(); }
-                            }
-                            break;
-                        }
+                    } else {
+                        // activate tab
+                        if (tab_used[i]) { active_tab = i; draw(); }
                     }
-                } else {
-                    // Scroll wheel handling in content area
-                    if (ev.xbutton.button == Button4) { scroll_offset += 3; draw(); }
-                    else if (ev.xbutton.button == Button5) { scroll_offset -= 3; if (scroll_offset < 0) scroll_offset = 0; draw(); }
+                    break;
                 }
             }
+        } else {
+            // Scroll wheel handling in content area
+            if (ev->button == 4) { scroll_offset += 3; invalidate(DAMAGE_TEXT); }
+            else if (ev->button == 5) { scroll_offset -= 3; if (scroll_offset < 0) scroll_offset = 0; invalidate(DAMAGE_TEXT); }
         }
-
-        // 3) Small sleep to avoid busy spin
-        struct timespec ts = {0, 16 * 1000 * 1000};
-        nanosleep(&ts, NULL);
     }
+}
+
+// Paint whatever is damaged right now, ignoring the frame interval
+void ui_paint(void) {
+    if (!damage) return;
+    paint();
+    clock_gettime(CLOCK_MONOTONIC, &last_paint);
+}
+
+int ui_open(const Backend *be) {
+    int ascent, descent;
+    ui = be;
+    if (ui->open(win_width, win_height, &ascent, &descent) < 0) return -1;
+    font_ascent = ascent;
+    line_height = ascent + descent + 2;
+    resize_backbuf(win_width, win_height);
+
+    // init tabs
+    size_t sb_bytes = scrollback_cap("MYTERM_SCROLLBACK", SCROLLBACK_MAX_BYTES);
+    size_t sb_lines = scrollback_cap("MYTERM_SCROLLBACK_LINES", SCROLLBACK_MAX_LINES);
+    for (int i=0;i<MAX_TABS;i++){ sb_init(&tabs[i].sb, sb_bytes, sb_lines); tabs[i].cap = (Capture){ .out_fd = -1, .err_fd = -1, .fg_child = -1 }; tabs[i].inputlen=0; tabs[i].cursor_idx=0; tab_used[i]=0; }
+    tab_used[0] = 1; // show Tab 1 by default
+    active_tab = 0;
+    refresh_cwd();
+
+    // Route SIGCHLD through a signalfd so the loop can block in poll()
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &chld, NULL) < 0) die("sigprocmask");
+    sig_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sig_fd < 0) die("signalfd");
+    return 0;
+}
+
+static int jobs_running(void) {
+    for (int i=0;i<MAX_TABS;i++) if (tabs[i].cap.active) return 1;
+    return 0;
+}
+
+int ui_run(void) {
+    for (;;) {
+        // 1) Pump child IO so output continues streaming
+        pump_child_io();
+        jobs_report();
+
+        // 2) Handle all pending input events without blocking; Ctrl+R sees
+        //    commands other instances have run up to now
+        history_sync();
+        while (ui->pending()) {
+            UiEvent ev;
+            ui->next_event(&ev);
+            ui_handle_event(&ev);
+        }
+        history_flush();   // one write for the commands entered this tick
+        if (quitting && !jobs_running()) break;
 
+        // 3) Paint if a frame is due, then sleep until input, child output,
+        //    a child state change or the next frame deadline
+        int timeout = paint_if_due();
+        int wait = ui->wait_ms();
+        if (wait >= 0 && (timeout < 0 || wait < timeout)) timeout = wait;
+        wait = multiwatch_timeout();
+        if (wait >= 0 && (timeout < 0 || wait < timeout)) timeout = wait;
+        struct pollfd pfds[4 + 2 * MAX_TABS + 2 * MAX_JOBS];
+        nfds_t npfd = 0;
+        pfds[npfd++] = (struct pollfd){ .fd = sig_fd, .events = POLLIN };
+        pfds[npfd++] = (struct pollfd){ .fd = complete_fd(), .events = POLLIN };
+        if (ui->conn_fd() >= 0) pfds[npfd++] = (struct pollfd){ .fd = ui->conn_fd(), .events = POLLIN };
+        for (int i=0;i<MAX_TABS;i++) {
+            Capture *c = &tabs[i].cap;
+            if (c->out_fd != -1) pfds[npfd++] = (struct pollfd){ .fd = c->out_fd, .events = POLLIN };
+            if (c->err_fd != -1) pfds[npfd++] = (struct pollfd){ .fd = c->err_fd, .events = POLLIN };
+        }
+        nfds_t job_pfd = npfd;
+        npfd += (nfds_t)jobs_pollfds(pfds + npfd, 2 * MAX_JOBS);
+        nfds_t watch_pfd = npfd;
+        npfd += (nfds_t)multiwatch_pollfds(pfds + npfd, 1);
+        if (poll(pfds, npfd, timeout) < 0 && errno != EINTR) die("poll");
+        if (pfds[0].revents & POLLIN) {
+            // one wakeup may stand for several children
+            struct signalfd_siginfo si;
+            while (read(sig_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {}
+            reap_children();
+        }
+        jobs_pump(pfds + job_pfd, (int)(watch_pfd - job_pfd));
+        multiwatch_pump(pfds + watch_pfd, (int)(npfd - watch_pfd));
+        multiwatch_tick();
+        if ((pfds[1].revents & POLLIN) && complete_poll() && completion_wait) {
+            // a directory scan finished: redo the pending Tab if the input is unchanged
+            Tab *t = &tabs[active_tab];
+            if (completion_wait_tab == active_tab && completion_wait_len == t->inputlen && completion_wait_cursor == t->cursor_idx) {
+                complete_tab(); invalidate(DAMAGE_INPUT);
+            } else {
+                completion_wait = 0;
+            }
+        }
+    }
+    pump_child_io();
+    jobs_hangup(NULL);
+    ui_paint();
+    ui->close();
     return 0;
 }
+
+#ifndef MYTERM_NO_MAIN
+int main() {
+    setlocale(LC_ALL, "");
+    // MYTERM_BACKEND=headless runs without a display (see backend_headless.c)
+    const char *be = getenv("MYTERM_BACKEND");
+    const Backend *backend = be && strcmp(be, "headless") == 0 ? &headless_backend : &x11_backend;
+    if (ui_open(backend) < 0) die(backend == &x11_backend ? "XOpenDisplay" : "backend open");
+    complete_init();
+    // history
+    history_init();
+    history_load();
+    append_output_str("Welcome to MyTerm\n");
+    return ui_run();
+}
+#endif
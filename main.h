@@ -1,4 +1,13 @@
 #ifndef MYTERM_MAIN_H
 #define MYTERM_MAIN_H
 
+#include "backend.h"
+
+// UI core entry points; main() is just ui_open() + ui_run(), and the
+// benchmark drives the same functions on the headless backend.
+int ui_open(const Backend *be);
+int ui_run(void);
+void ui_handle_event(const UiEvent *ev);
+void ui_paint(void);
+
 #endif // MYTERM_MAIN_H
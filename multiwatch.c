@@ -1,169 +1,572 @@
-// Enable POSIX clock_gettime on glibc
-#ifndef _POSIX_C_SOURCE
-#define _POSIX_C_SOURCE 200809L
+// multiWatch: several commands run side by side in one tab. Output is
+// framed by line, with a header whenever the source changes, or with -p
+// kept in one pane per command. With -n the commands run again every so
+// many seconds and each run is compared line by line with the one before:
+// only the lines that changed are stored, printed and repainted. A session
+// is the tab's foreground job. The pipes of every session sit in one epoll
+// set whose fd is all the main loop polls, so a wakeup costs in proportion
+// to the commands that wrote, not to how many are watched; children are
+// reaped by the central reaper (jobs.c).
+// pipe2 and clock_gettime
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
 #endif
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
-#include <poll.h>
+#include <errno.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
-#include <signal.h>
-#include <X11/Xlib.h>
-#include <X11/Xutil.h>
-#include <X11/keysym.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include "myterm.h"
+#include "scrollback.h"
+#include "vt.h"
 #include "multiwatch.h"
+#include "exec.h"
+#include "jobs.h"
+
+struct MultiWatch;
+typedef struct {
+    struct MultiWatch *s;   // session, and index in it, for epoll and the reaper
+    int i;
+    char *cmd;
+    int fd;                 // -1 at EOF
+    pid_t pid;              // 0 once reaped
+    char *carry;            // partial line waiting for its newline, MULTIWATCH_LINE bytes
+    size_t carry_len;
+    Scrollback pane;        // -p: this command's output
+    Vt vt;                  // -p and -n: escape sequences of the output
+    // -n: output of the run in progress, and the last finished run by line
+    char *run;
+    size_t run_len, run_cap;
+    char **lines;
+    unsigned char *changed; // line differs from the run before
+    size_t nlines, lines_cap;
+    unsigned long runs;
+    long long due;          // CLOCK_MONOTONIC ms of the next run, 0 while one is going
+    int dirty;              // pane needs repainting
+} Source;
+
+typedef struct MultiWatch {
+    struct MultiWatch *next;
+    Capture *tab;           // NULL once the tab closed
+    char *text;             // copy of the arguments; commands point into it
+    Source *src;
+    int n;
+    int open, running;      // pipes not at EOF, children not reaped
+    int paused;
+    int panes;              // -p
+    int interval;           // -n, in ms; 0 runs the commands once
+    int stopping;           // -n: Ctrl+C, start no more runs
+    long long next_due;     // -n: earliest due of the sources, 0 if none
+    int last;               // source the newest line in the tab came from
+} MultiWatch;
+
+static MultiWatch *sessions;
+static int epoll_fd = -1;   // pipes of all sessions
+
+static long long now_ms(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void tab_str(Capture *c, const char *str) {
+    if (c) capture_output(c, str, strlen(str));
+}
+
+static void out_str(MultiWatch *s, const char *str) { tab_str(s->tab, str); }
+
+static void out(MultiWatch *s, const char *buf, size_t n) {
+    if (s->tab) capture_output(s->tab, buf, n);
+}
+
+// A line of a pane or of an -n run: filtered already, markers and all
+static void out_line(MultiWatch *s, const char *buf, size_t n) {
+    if (s->tab) capture_marked(s->tab, buf, n);
+}
+
+// `"cmd" , <unix time>:` before lines of source i unless it wrote the last ones
+static void header(MultiWatch *s, int i) {
+    if (s->last == i) return;
+    s->last = i;
+    struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+    char tim[64];
+    snprintf(tim, sizeof(tim), "%ld.%03ld", (long)ts.tv_sec, ts.tv_nsec/1000000);
+    out_str(s, "\""); out_str(s, s->src[i].cmd); out_str(s, "\" , ");
+    out_str(s, tim); out_str(s, ":\n");
+}
+
+// Complete lines go to the tab; the partial last line waits in the carry
+// buffer for the rest of it (a line longer than the buffer is cut there)
+static void emit_lines(MultiWatch *s, int i, const char *buf, size_t n) {
+    Source *src = &s->src[i];
+    const char *nl = memrchr(buf, '\n', n);
+    if (!nl && src->carry_len + n <= MULTIWATCH_LINE) {
+        // most commands never need one
+        if (!src->carry && !(src->carry = malloc(MULTIWATCH_LINE))) die("malloc");
+        memcpy(src->carry + src->carry_len, buf, n);
+        src->carry_len += n;
+        return;
+    }
+    size_t upto = nl ? (size_t)(nl - buf) + 1 : n;
+    header(s, i);
+    out(s, src->carry, src->carry_len);
+    out(s, buf, upto);
+    if (!nl) out(s, "\n", 1);
+    src->carry_len = n - upto;
+    if (src->carry_len && !src->carry && !(src->carry = malloc(MULTIWATCH_LINE))) die("malloc");
+    memcpy(src->carry, buf + upto, src->carry_len);
+}
+
+// The last line of a command that ended without a newline
+static void flush_carry(MultiWatch *s, int i) {
+    Source *src = &s->src[i];
+    if (!src->carry_len) return;
+    header(s, i);
+    out(s, src->carry, src->carry_len);
+    out(s, "\n", 1);
+    src->carry_len = 0;
+}
+
+// A pane shows the command's scrollback, or with -n its last finished run
+static size_t pane_lines(const Source *src) {
+    return src->lines_cap ? src->nlines : sb_line_count(&src->pane);
+}
+
+static size_t pane_line(const Source *src, size_t k, char *buf, size_t n) {
+    if (src->lines_cap) {
+        size_t len = strlen(src->lines[k]);
+        if (len > n) len = n;
+        memcpy(buf, src->lines[k], len);
+        return len;
+    }
+    uint64_t ls, le;
+    sb_line(&src->pane, k, &ls, &le);
+    return sb_copy(&src->pane, ls, buf, le - ls < n ? (size_t)(le - ls) : n);
+}
+
+// -n: a changed line as printed in the tab: its number and text in the
+// accent colour wherever the command left the default one, as a pane
+// draws it
+static void out_changed(MultiWatch *s, size_t num, const char *line, size_t len) {
+    char buf[MULTIWATCH_LINE + 32];
+    size_t n = (size_t)snprintf(buf, sizeof(buf), "%c%c%4zu| ", VT_ATTR, VT_ATTR_ACCENT, num);
+    for (size_t i = 0; i < len && n + 4 <= sizeof(buf); i++) {
+        buf[n++] = line[i];
+        if (line[i] == VT_ATTR && i + 1 < len) {
+            i++;
+            buf[n++] = line[i] == VT_ATTR_DEFAULT ? VT_ATTR_ACCENT : line[i];
+        }
+    }
+    buf[n++] = VT_ATTR;
+    buf[n++] = VT_ATTR_DEFAULT;
+    out_line(s, buf, n);
+}
+
+// -n: compare the run that just finished with the one before, line by
+// line. Lines that are the same keep their stored copy; the others are
+// replaced, printed with their number under a fresh header (nothing at all
+// when the output did not change) and, from the second run on, drawn
+// highlighted, in the tab or in a pane.
+static void finish_run(MultiWatch *s, int i) {
+    Source *src = &s->src[i];
+    const char *p = src->run, *end = src->run + src->run_len;
+    int first = src->runs++ == 0;
+    size_t n = 0, changes = 0;
+    char line[MULTIWATCH_LINE];
+    s->last = -1;
+    src->vt = (Vt){0};
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t raw = nl ? (size_t)(nl - p) : (size_t)(end - p);
+        // lines are kept as they will be drawn: colours as markers, CR and BS applied
+        size_t len = vt_line(&src->vt, p, raw, line, sizeof(line));
+        if (n == src->lines_cap) {
+            src->lines_cap *= 2;
+            src->lines = realloc(src->lines, src->lines_cap * sizeof(*src->lines));
+            src->changed = realloc(src->changed, src->lines_cap);
+            if (!src->lines || !src->changed) die("realloc");
+        }
+        int same = n < src->nlines && strncmp(src->lines[n], line, len) == 0 && src->lines[n][len] == '\0';
+        unsigned char was = n < src->nlines ? src->changed[n] : 0;
+        if (!same) {
+            if (n < src->nlines) free(src->lines[n]);
+            if (!(src->lines[n] = strndup(line, len))) die("strndup");
+            changes++;
+            if (!s->panes) {
+                char num[32];
+                header(s, i);
+                if (first) {
+                    out(s, num, (size_t)snprintf(num, sizeof(num), "%4zu| ", n + 1));
+                    out_line(s, line, len);
+                } else {
+                    out_changed(s, n + 1, line, len);
+                }
+                out(s, "\n", 1);
+            }
+        }
+        src->changed[n] = !same && !first;
+        if (!same || was != src->changed[n]) src->dirty = 1;
+        n++;
+        p = nl ? nl + 1 : end;
+    }
+    if (src->nlines > n) {
+        if (!s->panes) {
+            char note[64];
+            header(s, i);
+            out(s, note, (size_t)snprintf(note, sizeof(note), "      (%zu lines fewer)\n", src->nlines - n));
+        }
+        for (size_t k = n; k < src->nlines; k++) free(src->lines[k]);
+        src->dirty = 1;
+    }
+    src->nlines = n;
+    src->run_len = 0;
+    src->due = now_ms() + s->interval;
+    if (!s->next_due || src->due < s->next_due) s->next_due = src->due;
+    if (s->panes && src->dirty && s->tab) capture_invalidate(s->tab, DAMAGE_TEXT);
+}
+
+// -p: what the panes showed stays in the tab once the session is over
+static void dump_panes(MultiWatch *s) {
+    char line[1024];
+    for (int i = 0; i < s->n; i++) {
+        size_t total = pane_lines(&s->src[i]);
+        if (total == 0) continue;
+        size_t first = total > MULTIWATCH_PANE_TAIL ? total - MULTIWATCH_PANE_TAIL : 0;
+        s->last = -1;
+        header(s, i);
+        for (size_t k = first; k < total; k++) {
+            out_line(s, line, pane_line(&s->src[i], k, line, sizeof(line)));
+            out(s, "\n", 1);
+        }
+    }
+}
+
+// Every command has exited and been read to the end (with -n, after Ctrl+C):
+// free the tab
+static void watch_check(MultiWatch *s) {
+    if (s->open || s->running) return;
+    if (s->interval && !s->stopping && s->tab) return;
+    Capture *c = s->tab;
+    if (c) {
+        if (s->panes) dump_panes(s);
+        c->watch = NULL;
+        c->active = 0;
+        c->pgid = 0;
+        trace_mark(&c->tl, TRACE_EXIT);
+        trace_settle(&c->tl);
+        capture_invalidate(c, DAMAGE_ALL);
+    }
+    for (int i = 0; i < s->n; i++) {
+        Source *src = &s->src[i];
+        if (s->panes && !s->interval) sb_free(&src->pane);
+        for (size_t k = 0; k < src->nlines; k++) free(src->lines[k]);
+        free(src->lines); free(src->changed); free(src->run); free(src->carry);
+    }
+    MultiWatch **pp = &sessions;
+    while (*pp != s) pp = &(*pp)->next;
+    *pp = s->next;
+    free(s->text);
+    free(s->src);
+    free(s);
+}
+
+// -n: a run is over once its output is read to the end and it has exited
+static void run_check(MultiWatch *s, int i) {
+    Source *src = &s->src[i];
+    if (s->interval && !s->stopping && src->fd == -1 && src->pid == 0 && !src->due) finish_run(s, i);
+}
+
+static void watch_child(void *owner, pid_t pid, int wstatus) {
+    Source *src = owner;
+    MultiWatch *s = src->s;
+    (void)pid;
+    if (WIFSTOPPED(wstatus) || WIFCONTINUED(wstatus)) return;
+    src->pid = 0;
+    s->running--;
+    run_check(s, src->i);
+    // the group is gone with its last process; its id may be reused
+    if (!s->running && s->tab) s->tab->pgid = 0;
+    watch_check(s);
+}
+
+// -n: keep a run's output until it is over (past MULTIWATCH_RUN_MAX it is cut)
+static void run_append(Source *src, const char *buf, size_t n) {
+    if (src->run_len + n > MULTIWATCH_RUN_MAX) n = MULTIWATCH_RUN_MAX - src->run_len;
+    if (src->run_len + n > src->run_cap) {
+        src->run_cap = src->run_cap ? src->run_cap * 2 : MULTIWATCH_LINE;
+        if (src->run_cap < src->run_len + n) src->run_cap = src->run_len + n;
+        if (!(src->run = realloc(src->run, src->run_cap))) die("realloc");
+    }
+    memcpy(src->run + src->run_len, buf, n);
+    src->run_len += n;
+}
+
+// Output of command i, as it arrives
+static void source_output(MultiWatch *s, Source *src, const char *buf, size_t n) {
+    if (s->interval) run_append(src, buf, n);
+    else if (s->panes) { vt_write(&src->vt, &src->pane, buf, n); src->dirty = 1; capture_invalidate(s->tab, DAMAGE_TEXT); }
+    else emit_lines(s, src->i, buf, n);
+}
+
+static int fail_msg(char *buf, size_t cap, const char *what, int err) {
+    int len = snprintf(buf, cap, "multiWatch: %s: %s\n", what, strerror(err));
+    return len < (int)cap ? len : (int)cap - 1;
+}
 
-void multiwatch_run(char *argstr) {
+// Start (or with -n, start again) command i. All the commands running at
+// one time share a process group, so Ctrl+C and Ctrl+Z reach every one.
+// A command that cannot start shows why as its output, in its pane or
+// under its header.
+static void start_source(MultiWatch *s, int i) {
+    Capture *c = s->tab;
+    Source *src = &s->src[i];
+    int pipefd[2];
+    char msg[256];
+    src->due = 0;
+    if (pipe2(pipefd, O_CLOEXEC) < 0) {
+        source_output(s, src, msg, (size_t)fail_msg(msg, sizeof(msg), "pipe", errno));
+        run_check(s, i);
+        return;
+    }
+    // stdout and stderr both go to the pipe; run through sh -c
+    char *argv[] = { "/bin/sh", "-c", src->cmd, NULL };
+    if (!s->running) c->pgid = 0;
+    pid_t pid = 0;
+    int rc = spawn_process(&pid, argv, -1, pipefd[1], pipefd[1], c->pgid);
+    if (rc != 0) {
+        pid = 0;
+        // short enough for the pipe: it is read like any other output
+        ssize_t w = write(pipefd[1], msg, (size_t)fail_msg(msg, sizeof(msg), "/bin/sh", rc));
+        (void)w;
+    }
+    close(pipefd[1]);
+    if (pid > 0) {
+        if (!c->pgid) c->pgid = pid;
+        child_watch(pid, watch_child, src);
+        s->running++;
+    }
+    int fl = fcntl(pipefd[0], F_GETFL, 0); fcntl(pipefd[0], F_SETFL, fl | O_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = src };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pipefd[0], &ev) < 0) die("epoll_ctl");
+    src->fd = pipefd[0];
+    src->pid = pid;
+    s->open++;
+}
+
+static void source_close(MultiWatch *s, Source *src) {
+    // a forked builtin elsewhere may still hold a copy of the fd, which
+    // would keep it in the epoll set past close()
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+    close(src->fd);
+    src->fd = -1;
+    s->open--;
+}
+
+// How many commands may run: each holds a pipe fd for as long as it runs,
+// so n is checked against the fd limit (raised towards the hard limit if
+// need be), keeping MULTIWATCH_FD_SPARE for the rest of the terminal
+static int watch_limit(int n) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return MULTIWATCH_MAX;
+    rlim_t want = (rlim_t)n + MULTIWATCH_FD_SPARE;
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < want) {
+        rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max > want ? want : rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) < 0) getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= (rlim_t)MULTIWATCH_MAX + MULTIWATCH_FD_SPARE) return MULTIWATCH_MAX;
+    return rl.rlim_cur > MULTIWATCH_FD_SPARE ? (int)(rl.rlim_cur - MULTIWATCH_FD_SPARE) : 0;
+}
+
+int multiwatch_start(Capture *c, char *argstr) {
+    if (c->active) { tab_str(c, "myterm: a command is already running in this tab\n"); return -1; }
+    MultiWatch *s = calloc(1, sizeof(*s));
+    if (!s || !(s->text = strdup(argstr))) die("calloc");
+    s->last = -1;
+    char *p = s->text;
+    // options before the list: -p, -n secs
+    for (;;) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (p[0] != '-') break;
+        if (p[1] == 'p' && (!p[2] || strchr(" \t[", p[2]))) { s->panes = 1; p += 2; continue; }
+        if (p[1] == 'n') {
+            char *end;
+            double secs = strtod(p + 2, &end);
+            if (end != p + 2 && secs > 0 && secs <= 86400 && (!*end || strchr(" \t[", *end))) {
+                s->interval = secs < MULTIWATCH_MIN_INTERVAL / 1000.0 ? MULTIWATCH_MIN_INTERVAL : (int)(secs * 1000);
+                p = end;
+                continue;
+            }
+        }
+        tab_str(c, "multiWatch: usage: multiWatch [-n secs] [-p] [\"cmd1\", \"cmd2\", ...]\n");
+        free(s->text); free(s);
+        return -1;
+    }
     // Expect format: ["cmd1", "cmd2", ...]
     // crude parse: extract quoted strings
-    char *p = argstr;
-    char *cmds[64]; int ncmd=0;
-    while (*p && ncmd < 64) {
+    int cap = 0;
+    while (*p) {
         while (*p && *p!='"') p++;
         if (!*p) break;
         p++;
-        cmds[ncmd++] = p;
+        if (s->n == cap) {
+            cap = cap ? cap * 2 : 8;
+            if (!(s->src = realloc(s->src, cap * sizeof(*s->src)))) die("realloc");
+        }
+        s->src[s->n] = (Source){ .s = s, .i = s->n, .cmd = p, .fd = -1 };
+        s->n++;
         while (*p && *p!='"') p++;
         if (*p) *p++='\0';
     }
-    if (ncmd==0) { append_output_str("multiWatch: no commands\n"); return; }
-
-    // create pipes and child processes
-    int rfd[64]; pid_t pids[64];
-    for (int i=0;i<ncmd;i++) {
-        int pipefd[2];
-        if (pipe(pipefd) < 0) { append_output_str("multiWatch: pipe failed\n"); return; }
-        pid_t pid = fork();
-        if (pid==0) {
-            // child: redirect stdout/stderr to pipe write end and exec via sh -c
-            close(pipefd[0]);
-            dup2(pipefd[1], STDOUT_FILENO);
-            dup2(pipefd[1], STDERR_FILENO);
-            for (int k=3;k<256;k++) close(k);
-            execl("/bin/sh", "sh", "-c", cmds[i], (char*)NULL);
-            _exit(127);
-        }
-        // parent
-        close(pipefd[1]);
-        int fl = fcntl(pipefd[0], F_GETFL, 0); fcntl(pipefd[0], F_SETFL, fl | O_NONBLOCK);
-        rfd[i] = pipefd[0];
-        pids[i] = pid;
-    }
-
-    struct pollfd pfds[64];
-    for (int i=0;i<ncmd;i++) { pfds[i].fd = rfd[i]; pfds[i].events = POLLIN | POLLHUP; }
-    int open_streams = ncmd;
-    append_output_str("multiWatch started. Press Ctrl+C to stop.\n");
-    while (open_streams>0) {
-        // Check X11 events for Ctrl+C and Ctrl+Z
-        while (XPending(dpy_global)) {
-            XEvent ev;
-            XNextEvent(dpy_global, &ev);
-            if (ev.type == KeyPress) {
-                KeySym ks;
-                char kb[8];
-                XLookupString(&ev.xkey, kb, sizeof(kb), &ks, NULL);
-                if ((ev.xkey.state & ControlMask) && (ks == XK_c || ks == XK_C)) {
-                    interrupt_requested = 1;
-                }
-                if ((ev.xkey.state & ControlMask) && (ks == XK_z || ks == XK_Z)) {
-                    // Ctrl+Z: suspend all processes and return
-                    append_output_str("\n^Z\n[multiWatch processes suspended and moved to background]\n");
-                    for (int i=0;i<ncmd;i++) {
-                        if (pids[i] > 0) {
-                            kill(pids[i], SIGTSTP);  // suspend, don't kill
-                        }
-                    }
-                    // Close pipes and return (processes remain suspended in background)
-                    for (int i=0;i<ncmd;i++) {
-                        if (pfds[i].fd >= 0) { close(pfds[i].fd); pfds[i].fd = -1; }
-                    }
-                    draw();
-                    return;
-                }
-            }
+    if (s->n==0) { tab_str(c, "multiWatch: no commands\n"); free(s->text); free(s); return -1; }
+    int max = watch_limit(s->n);
+    if (s->n > max) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "multiWatch: %d commands, at most %d can run (see ulimit -n)\n", s->n, max);
+        tab_str(c, msg);
+        free(s->text); free(s->src); free(s);
+        return -1;
+    }
+    if (epoll_fd == -1 && (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) die("epoll_create1");
+
+    s->tab = c;
+    for (int i=0;i<s->n;i++) {
+        Source *src = &s->src[i];
+        if (s->interval) {
+            src->lines_cap = 16;
+            src->lines = malloc(src->lines_cap * sizeof(*src->lines));
+            src->changed = malloc(src->lines_cap);
+            if (!src->lines || !src->changed) die("malloc");
+        } else if (s->panes) {
+            sb_init(&src->pane, MULTIWATCH_PANE_BYTES, MULTIWATCH_PANE_LINES);
         }
-        
-        // Check for Ctrl+C interrupt
-        if (interrupt_requested) {
-            append_output_str("\nmultiWatch interrupted by Ctrl+C\n");
-            // Kill all child processes
-            for (int i=0;i<ncmd;i++) {
-                if (pids[i] > 0) {
-                    kill(pids[i], SIGINT);
-                    waitpid(pids[i], NULL, 0);  // reap immediately
-                    pids[i] = 0;
-                }
-            }
-            // Close all pipes
-            for (int i=0;i<ncmd;i++) {
-                if (pfds[i].fd >= 0) {
-                    close(pfds[i].fd);
-                    pfds[i].fd = -1;
-                }
-            }
-            draw();
-            return;
+        start_source(s, i);
+    }
+    s->next = sessions;
+    sessions = s;
+    c->watch = s;
+    c->active = 1;
+    c->nstages = 0;
+    snprintf(c->command, sizeof(c->command), "multiWatch");
+    trace_mark(&c->tl, TRACE_SPAWNED);
+    out_str(s, "multiWatch started. Press Ctrl+C to stop.\n");
+    for (int i = 0; i < s->n; i++) run_check(s, i);
+    watch_check(s);
+    return 0;
+}
+
+int multiwatch_pollfds(struct pollfd *p, int max) {
+    if (!sessions || max < 1) return 0;
+    p[0] = (struct pollfd){ .fd = epoll_fd, .events = POLLIN };
+    return 1;
+}
+
+// What a command wrote since the last wakeup, up to MULTIWATCH_BUDGET
+// bytes; the rest stays in its pipe for the next round, so one flooding
+// command cannot hold up the others
+static void watch_read(Source *src) {
+    MultiWatch *s = src->s;
+    char buf[MULTIWATCH_LINE];
+    for (size_t total = 0; total < MULTIWATCH_BUDGET; ) {
+        ssize_t n = read(src->fd, buf, sizeof(buf));
+        if (n > 0 && s->tab) {
+            source_output(s, src, buf, (size_t)n);
+            trace_mark(&s->tab->tl, TRACE_FIRST_BYTE);
         }
-        
-        int r = poll(pfds, (nfds_t)ncmd, 200);
-        
-        // Check interrupt again after poll (user may have pressed Ctrl+C during poll)
-        if (interrupt_requested) {
-            append_output_str("\nmultiWatch interrupted by Ctrl+C\n");
-            for (int i=0;i<ncmd;i++) {
-                if (pids[i] > 0) { kill(pids[i], SIGINT); waitpid(pids[i], NULL, 0); pids[i] = 0; }
-            }
-            for (int i=0;i<ncmd;i++) {
-                if (pfds[i].fd >= 0) { close(pfds[i].fd); pfds[i].fd = -1; }
-            }
-            draw();
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            if (!s->panes && !s->interval) flush_carry(s, src->i);
+            source_close(s, src);
+            run_check(s, src->i);
             return;
         }
-        
-        if (r>0) {
-            for (int i=0;i<ncmd;i++) {
-                if (pfds[i].fd < 0) continue;
-                
-                // Check interrupt before processing each stream
-                if (interrupt_requested) {
-                    append_output_str("\nmultiWatch interrupted by Ctrl+C\n");
-                    for (int j=0;j<ncmd;j++) {
-                        if (pids[j] > 0) { kill(pids[j], SIGINT); waitpid(pids[j], NULL, 0); pids[j] = 0; }
-                    }
-                    for (int j=0;j<ncmd;j++) {
-                        if (pfds[j].fd >= 0) { close(pfds[j].fd); pfds[j].fd = -1; }
-                    }
-                    draw();
-                    return;
-                }
-                
-                if (pfds[i].revents & (POLLIN|POLLHUP)) {
-                    char buf[256];
-                    ssize_t n = read(pfds[i].fd, buf, sizeof(buf));
-                    if (n > 0) {
-                        struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
-                        char tim[64];
-                        snprintf(tim, sizeof(tim), "%ld.%03ld", (long)ts.tv_sec, ts.tv_nsec/1000000);
-                        append_output_str("\n\""); append_output_str(cmds[i]); append_output_str("\" , ");
-                        append_output_str(tim); append_output_str(":\n");
-                        append_output_str("----------------------------------------------------\n");
-                        append_output(buf, (size_t)n);
-                        append_output_str("\n----------------------------------------------------\n");
-                        draw();
-                    }
-                    if (n == 0 || (pfds[i].revents & POLLHUP)) { close(pfds[i].fd); pfds[i].fd = -1; open_streams--; draw(); }
-                }
-            }
-        }
-        for (int i=0;i<ncmd;i++) if (pids[i]>0) {
-            int st; pid_t w = waitpid(pids[i], &st, WNOHANG);
-            if (w==pids[i]) { pids[i]=0; }
+        if (n < 0 || (size_t)n < sizeof(buf)) return;   // drained
+        total += (size_t)n;
+    }
+}
+
+void multiwatch_pump(const struct pollfd *p, int n) {
+    if (n < 1 || !p[0].revents) return;
+    // Level-triggered: a source left with data is reported again, behind
+    // the ones that became ready meanwhile
+    struct epoll_event ev[MULTIWATCH_EVENTS];
+    int ready = epoll_wait(epoll_fd, ev, MULTIWATCH_EVENTS, 0);
+    for (int k = 0; k < ready; k++) watch_read(ev[k].data.ptr);
+    // sessions are only freed here, after every event of the batch is handled
+    for (MultiWatch *s = sessions, *next; s; s = next) {
+        next = s->next;
+        watch_check(s);
+    }
+}
+
+int multiwatch_timeout(void) {
+    long long next = -1;
+    for (MultiWatch *s = sessions; s; s = s->next)
+        if (s->next_due && !s->paused && !s->stopping && (next < 0 || s->next_due < next)) next = s->next_due;
+    if (next < 0) return -1;
+    long long wait = next - now_ms();
+    return wait < 0 ? 0 : (int)wait;
+}
+
+void multiwatch_tick(void) {
+    long long now = now_ms();
+    for (MultiWatch *s = sessions; s; s = s->next) {
+        if (!s->next_due || s->next_due > now || s->paused || s->stopping || !s->tab) continue;
+        s->next_due = 0;
+        for (int i = 0; i < s->n; i++) {
+            long long due = s->src[i].due;
+            if (due && due <= now) start_source(s, i);
+            else if (due && (!s->next_due || due < s->next_due)) s->next_due = due;
         }
-        // Handle Ctrl+C from GUI is done in main loop; we just stream here
     }
 }
+
+void multiwatch_pause(Capture *c) {
+    MultiWatch *s = c->watch;
+    if (!s) return;
+    s->paused = !s->paused;
+    if (c->pgid > 0) kill(-c->pgid, s->paused ? SIGTSTP : SIGCONT);
+    out_str(s, s->paused ? "\n[multiWatch stopped; Ctrl+Z continues, Ctrl+C ends it]\n" : "\n[multiWatch continued]\n");
+}
+
+void multiwatch_detach(Capture *c) {
+    MultiWatch *s = c->watch;
+    if (!s) return;
+    for (int i = 0; i < s->n; i++) if (s->src[i].fd != -1) source_close(s, &s->src[i]);
+    s->tab = NULL;
+    c->watch = NULL;
+    watch_check(s);
+}
+
+void multiwatch_stop(Capture *c) {
+    MultiWatch *s = c->watch;
+    if (!s) return;
+    s->stopping = 1;
+    watch_check(s);
+}
+
+int multiwatch_panes(const Capture *c) {
+    return c->watch && c->watch->panes ? c->watch->n : 0;
+}
+
+size_t multiwatch_pane(const Capture *c, int i, const char **title) {
+    *title = c->watch->src[i].cmd;
+    return pane_lines(&c->watch->src[i]);
+}
+
+size_t multiwatch_pane_line(const Capture *c, int i, size_t k, char *buf, size_t n, int *changed) {
+    const Source *src = &c->watch->src[i];
+    *changed = src->lines_cap && src->changed[k];
+    return pane_line(src, k, buf, n);
+}
+
+int multiwatch_pane_dirty(Capture *c, int i) {
+    Source *src = &c->watch->src[i];
+    int dirty = src->dirty;
+    src->dirty = 0;
+    return dirty;
+}
@@ -1,6 +1,72 @@
 #ifndef MULTIWATCH_H
 #define MULTIWATCH_H
 
-void multiwatch_run(char *argstr);
+#include <poll.h>
+#include "myterm.h"
+#include "scrollback.h"
+
+#ifndef MULTIWATCH_MAX
+#define MULTIWATCH_MAX 4096 // commands per multiWatch
+#endif
+// File descriptors left to the rest of the terminal when the commands'
+// pipes are counted against RLIMIT_NOFILE
+#ifndef MULTIWATCH_FD_SPARE
+#define MULTIWATCH_FD_SPARE 64
+#endif
+// Bytes read from one command per wakeup, and ready pipes handled per wakeup
+#ifndef MULTIWATCH_BUDGET
+#define MULTIWATCH_BUDGET (16 * 1024)
+#endif
+#ifndef MULTIWATCH_EVENTS
+#define MULTIWATCH_EVENTS 256
+#endif
+// Longest line kept whole; longer ones are cut at this length
+#ifndef MULTIWATCH_LINE
+#define MULTIWATCH_LINE 4096
+#endif
+// -p: scrollback of each pane, and lines of it left in the tab at the end
+#ifndef MULTIWATCH_PANE_BYTES
+#define MULTIWATCH_PANE_BYTES (128 * 1024)
+#endif
+#ifndef MULTIWATCH_PANE_LINES
+#define MULTIWATCH_PANE_LINES 2000
+#endif
+#ifndef MULTIWATCH_PANE_TAIL
+#define MULTIWATCH_PANE_TAIL 10
+#endif
+// -n: shortest interval (ms), and output of one run kept for comparing
+#ifndef MULTIWATCH_MIN_INTERVAL
+#define MULTIWATCH_MIN_INTERVAL 100
+#endif
+#ifndef MULTIWATCH_RUN_MAX
+#define MULTIWATCH_RUN_MAX (256 * 1024)
+#endif
+
+// multiWatch [-n secs] [-p] ["cmd1", "cmd2", ...]: start the commands as the
+// foreground job of capture c's tab. The main loop polls the one fd that
+// multiwatch_pollfds() gives (an epoll set of every session's pipes) and
+// multiwatch_pump() reads the ready ones, so the UI and other tabs keep
+// running meanwhile. The tab is free again once every command has exited,
+// or with -n once Ctrl+C has stopped the runs. Returns -1 if nothing started.
+int multiwatch_start(Capture *c, char *argstr);
+int multiwatch_pollfds(struct pollfd *p, int max);
+void multiwatch_pump(const struct pollfd *p, int n);
+// -n: ms until the next run is due (-1: none), and starting the due ones
+int multiwatch_timeout(void);
+void multiwatch_tick(void);
+// Ctrl+Z: stop the commands, or let them go on if they are stopped
+void multiwatch_pause(Capture *c);
+// Ctrl+C: start no more -n runs; the session ends once the running ones exit
+void multiwatch_stop(Capture *c);
+// The tab is closing: drop its output, the commands are hung up by the caller
+void multiwatch_detach(Capture *c);
+// -p: panes of capture c's session (0 when output scrolls in the tab), pane
+// i's command and line count, and its line k (*changed: differs from the
+// run before). multiwatch_pane_dirty() tells whether pane i changed since
+// it was last asked, so a frame repaints only those.
+int multiwatch_panes(const Capture *c);
+size_t multiwatch_pane(const Capture *c, int i, const char **title);
+size_t multiwatch_pane_line(const Capture *c, int i, size_t k, char *buf, size_t n, int *changed);
+int multiwatch_pane_dirty(Capture *c, int i);
 
 #endif // MULTIWATCH_H
@@ -1,13 +1,9 @@
 #ifndef MYTERM_H
 #define MYTERM_H
 
-#include <sys/types.h>
-
-// Forward declaration for X11 Display type
-typedef struct _XDisplay Display;
-
 #include <stddef.h>
 #include <sys/types.h>
+#include "trace.h"
 
 // Shared constants
 #ifndef BUF_SIZE
@@ -23,37 +19,63 @@ typedef struct _XDisplay Display;
 #define MAX_PIPE 16
 #endif
 
-// Provided by UI (src/main.c)
+// Provided by UI (main.c)
 void append_output(const char *s, size_t n);
 void append_output_str(const char *s);
 void die(const char *msg);
-// UI repaint
-void draw(void);
-
-// Foreground capture state (defined in src/main.c, used by exec.c)
-extern int cap_out_fd;
-extern int cap_err_fd;
-extern pid_t cap_pids[MAX_PIPE];
-extern int cap_nstages;
-extern int cap_active;
-extern pid_t fg_child;
-
-// Interrupt flag for Ctrl+C (set by main loop, checked by blocking operations)
-extern volatile int interrupt_requested;
+// Empty the current tab's scrollback
+void clear_screen(void);
+// Undo the UI's signal mask in a freshly forked child
+void reset_child_signals(void);
+// UI repaint: regions are marked dirty and painted together at most once per frame
+#define DAMAGE_TABBAR 0x1
+#define DAMAGE_TEXT   0x2
+#define DAMAGE_INPUT  0x4   // prompt, input lines and caret
+#define DAMAGE_ALL    (DAMAGE_TABBAR | DAMAGE_TEXT | DAMAGE_INPUT)
+void invalidate(unsigned regions);
+void draw(void);            // invalidate everything
+// Paint pending damage if a frame is due; returns ms until the next frame, -1 if clean
+int paint_if_due(void);
 
-// X11 display for event checking in blocking operations (defined in main.c)
-extern Display *dpy_global;
+// Command line a tab is working through: a shared parse (parse.c) and
+// the position in it
+struct Parsed;
+struct MultiWatch;
+typedef struct {
+    struct Parsed *parsed;  // NULL when idle
+    int next;               // next list item to consider
+    int status;             // exit status of the last pipeline
+} Plan;
 
-// Background job tracking
-#define MAX_JOBS 64
+// Foreground job of a tab: the running pipeline and the pipes its output is
+// captured from. Every tab owns one; all of them are polled by the main loop.
 typedef struct {
+    int out_fd;
+    int err_fd;
+    pid_t pids[MAX_PIPE];   // 0 once reaped
+    int nstages;
     int active;
-    pid_t pids[MAX_PIPE];
-    int nprocs;
-    char command[256];
-} BackgroundJob;
+    pid_t pgid;         // process group of the pipeline, signalled as a whole
+    pid_t fg_child;     // last stage, target of job messages
+    char command[128];  // pipeline text for the job table
+    int status;         // exit status of the last stage once reaped
+    Plan plan;          // rest of the command line
+    struct MultiWatch *watch;   // multiWatch session running instead (multiwatch.c)
+    Timeline tl;        // launch milestones of the command
+} Capture;
+
+// Capture slot of the tab the current command was typed in (defined in main.c)
+Capture *current_capture(void);
+// Append to the scrollback of the tab that owns capture c
+void capture_output(Capture *c, const char *s, size_t n);
+// The same for text a Vt already filtered: its colour markers are kept
+void capture_marked(Capture *c, const char *s, size_t n);
+// invalidate() if that tab is the one on screen
+void capture_invalidate(Capture *c, unsigned regions);
 
-extern BackgroundJob bg_jobs[MAX_JOBS];
-extern int bg_job_count;
+// Background and stopped jobs (jobs.c)
+#ifndef MAX_JOBS
+#define MAX_JOBS 64
+#endif
 
 #endif // MYTERM_H
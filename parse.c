@@ -0,0 +1,357 @@
+// Command line lexer and recursive-descent parser. One pass over the line:
+// words are unquoted straight into a buffer in the command's arena, and the
+// grammar is the usual shell one minus expansions:
+//
+//   list     := and_or ((';' | '&' | '\n') and_or)* [';' | '&']
+//   and_or   := pipeline (('&&' | '||') pipeline)*
+//   pipeline := command ('|' command)*
+//   command  := word-or-redir+ | '(' list ')' redir*
+//   redir    := [n]'<' w | [n]'>' w | [n]'>>' w | [n]'>&' m | [n]'<<<' w
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myterm.h"
+#include "parse.h"
+
+#ifndef PARSE_CACHE_SIZE
+#define PARSE_CACHE_SIZE 16
+#endif
+#ifndef ARENA_BLOCK
+#define ARENA_BLOCK 4096
+#endif
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t used, cap;
+};
+// data follows the header, padded to ARENA_ALIGN
+#define BLOCK_HDR ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void *arena_alloc(Arena *a, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *b = a->head;
+    if (!b || b->cap - b->used < n) {
+        size_t cap = n > ARENA_BLOCK ? n : ARENA_BLOCK;
+        b = malloc(BLOCK_HDR + cap);
+        if (!b) die("malloc");
+        b->cap = cap;
+        b->used = 0;
+        b->next = a->head;
+        a->head = b;
+    }
+    void *p = (char *)b + BLOCK_HDR + b->used;
+    b->used += n;
+    return p;
+}
+
+void arena_free(Arena *a) {
+    while (a->head) {
+        ArenaBlock *b = a->head;
+        a->head = b->next;
+        free(b);
+    }
+}
+
+enum { T_END, T_WORD, T_NEWLINE, T_SEMI, T_AMP, T_AND, T_OR, T_PIPE, T_LPAREN, T_RPAREN,
+       T_LT, T_GT, T_DGT, T_GTAMP, T_TLT };
+static const char *const tok_text[] = {
+    "end of line", "word", "newline", ";", "&", "&&", "||", "|", "(", ")", "<", ">", ">>", ">&", "<<<",
+};
+
+typedef struct {
+    int type;
+    char *word;         // T_WORD, unquoted
+    int io_fd;          // redirection operators: explicit fd prefix, or -1
+} Token;
+
+typedef struct {
+    const char *p;      // next unread character
+    char *out;          // where the next unquoted word is written
+    Arena *a;
+    Token tok;          // lookahead
+    const char *err;
+} Parser;
+
+static char errbuf[128];
+
+static void error(Parser *ps, const char *msg) {
+    if (ps->err) return;
+    snprintf(errbuf, sizeof(errbuf), "%s", msg);
+    ps->err = errbuf;
+    ps->tok.type = T_END;
+}
+
+static void syntax_error(Parser *ps) {
+    if (ps->err) return;
+    if (ps->tok.type == T_END) snprintf(errbuf, sizeof(errbuf), "syntax error: unexpected end of line");
+    else snprintf(errbuf, sizeof(errbuf), "syntax error near `%.64s'", ps->tok.type == T_WORD ? ps->tok.word : tok_text[ps->tok.type]);
+    ps->err = errbuf;
+    ps->tok.type = T_END;
+}
+
+static int is_meta(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ';' || c == '&' || c == '|' ||
+           c == '(' || c == ')' || c == '<' || c == '>';
+}
+
+// Unquote one word into ps->out
+static void lex_word(Parser *ps, const char *p) {
+    char *w = ps->out;
+    while (*p && !is_meta(*p)) {
+        if (*p == '\'') {
+            const char *q = strchr(p + 1, '\'');
+            if (!q) { error(ps, "unterminated quote"); return; }
+            memcpy(w, p + 1, (size_t)(q - p - 1));
+            w += q - p - 1;
+            p = q + 1;
+        } else if (*p == '"') {
+            for (p++; *p && *p != '"'; ) {
+                if (*p == '\\' && p[1] && strchr("\"\\$`\n", p[1])) {
+                    if (p[1] == '\n') { p += 2; continue; }
+                    p++;
+                }
+                *w++ = *p++;
+            }
+            if (!*p) { error(ps, "unterminated quote"); return; }
+            p++;
+        } else if (*p == '\\') {
+            p++;
+            if (*p == '\n') p++;
+            else if (*p) *w++ = *p++;
+        } else {
+            *w++ = *p++;
+        }
+    }
+    *w++ = '\0';
+    ps->tok.type = T_WORD;
+    ps->tok.word = ps->out;
+    ps->out = w;
+    ps->p = p;
+}
+
+static void next(Parser *ps) {
+    if (ps->err) return;
+    const char *p = ps->p;
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    Token *t = &ps->tok;
+    t->word = NULL;
+    t->io_fd = -1;
+    // a digit run directly before < or > names the fd being redirected
+    const char *d = p;
+    int fd = 0;
+    while (*d >= '0' && *d <= '9') { if (fd < 1000) fd = fd * 10 + (*d - '0'); d++; }
+    if (d > p && (*d == '<' || *d == '>')) { t->io_fd = fd; p = d; }
+    int len = 1;
+    switch (*p) {
+    case '\0': t->type = T_END; len = 0; break;
+    case '\n': t->type = T_NEWLINE; break;
+    case ';':  t->type = T_SEMI; break;
+    case '(':  t->type = T_LPAREN; break;
+    case ')':  t->type = T_RPAREN; break;
+    case '&':  if (p[1] == '&') { t->type = T_AND; len = 2; } else t->type = T_AMP; break;
+    case '|':  if (p[1] == '|') { t->type = T_OR; len = 2; } else t->type = T_PIPE; break;
+    case '<':  if (p[1] == '<' && p[2] == '<') { t->type = T_TLT; len = 3; } else t->type = T_LT; break;
+    case '>':
+        if (p[1] == '>') { t->type = T_DGT; len = 2; }
+        else if (p[1] == '&') { t->type = T_GTAMP; len = 2; }
+        else t->type = T_GT;
+        break;
+    default:
+        lex_word(ps, p);
+        return;
+    }
+    ps->p = p + len;
+}
+
+static void skip_newlines(Parser *ps) {
+    while (ps->tok.type == T_NEWLINE) next(ps);
+}
+
+static Node *new_node(Parser *ps, int type) {
+    Node *n = arena_alloc(ps->a, sizeof(*n));
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    return n;
+}
+
+// Parse a redirection if one starts here: 1 = parsed, 0 = none, -1 = error
+static int parse_redir(Parser *ps, Redir ***tail) {
+    int t = ps->tok.type;
+    if (t != T_LT && t != T_GT && t != T_DGT && t != T_GTAMP && t != T_TLT) return 0;
+    Redir *r = arena_alloc(ps->a, sizeof(*r));
+    memset(r, 0, sizeof(*r));
+    r->fd = ps->tok.io_fd >= 0 ? ps->tok.io_fd : (t == T_LT || t == T_TLT) ? 0 : 1;
+    r->kind = t == T_LT ? REDIR_IN : t == T_GT ? REDIR_OUT : t == T_DGT ? REDIR_APPEND : t == T_GTAMP ? REDIR_DUP : REDIR_HERESTR;
+    next(ps);
+    if (ps->tok.type != T_WORD) { syntax_error(ps); return -1; }
+    if (r->fd > 2) { error(ps, "only fds 0-2 can be redirected"); return -1; }
+    r->word = ps->tok.word;
+    if (r->kind == REDIR_DUP) {
+        if (r->word[0] < '0' || r->word[0] > '2' || r->word[1]) { error(ps, "only fds 0-2 can be duplicated"); return -1; }
+        r->dup_fd = r->word[0] - '0';
+    }
+    next(ps);
+    **tail = r;
+    *tail = &r->next;
+    return 1;
+}
+
+static Node *parse_list(Parser *ps, int nested);
+
+// NULL without an error when no command starts here
+static Node *parse_command(Parser *ps) {
+    if (ps->tok.type == T_LPAREN) {
+        next(ps);
+        Node *body = parse_list(ps, 1);
+        if (!body) return NULL;
+        if (body->n == 0 || ps->tok.type != T_RPAREN) { syntax_error(ps); return NULL; }
+        next(ps);
+        Node *n = new_node(ps, NODE_SUBSHELL);
+        n->body = body;
+        Redir **tail = &n->redirs;
+        int r;
+        while ((r = parse_redir(ps, &tail)) > 0) {}
+        return r < 0 ? NULL : n;
+    }
+    char *args[MAX_ARGS];
+    int argc = 0;
+    Redir *redirs = NULL, **tail = &redirs;
+    for (;;) {
+        if (ps->tok.type == T_WORD) {
+            if (argc == MAX_ARGS - 1) { error(ps, "too many arguments"); return NULL; }
+            args[argc++] = ps->tok.word;
+            next(ps);
+            continue;
+        }
+        int r = parse_redir(ps, &tail);
+        if (r < 0) return NULL;
+        if (r == 0) break;
+    }
+    if (argc == 0 && !redirs) return NULL;
+    Node *n = new_node(ps, NODE_CMD);
+    n->n = argc;
+    n->argv = arena_alloc(ps->a, (size_t)(argc + 1) * sizeof(char *));
+    memcpy(n->argv, args, (size_t)argc * sizeof(char *));
+    n->argv[argc] = NULL;
+    n->builtin = argc > 0 ? builtin_find(args[0]) : NULL;
+    n->redirs = redirs;
+    return n;
+}
+
+static Node *parse_pipeline(Parser *ps) {
+    Node *stages[MAX_PIPE];
+    int n = 0;
+    for (;;) {
+        Node *c = parse_command(ps);
+        if (!c) { if (n > 0) syntax_error(ps); return NULL; }
+        if (n == MAX_PIPE) { error(ps, "too many pipeline stages"); return NULL; }
+        stages[n++] = c;
+        if (ps->tok.type != T_PIPE) break;
+        next(ps);
+        skip_newlines(ps);
+    }
+    Node *p = new_node(ps, NODE_PIPE);
+    p->n = n;
+    p->stages = arena_alloc(ps->a, (size_t)n * sizeof(Node *));
+    memcpy(p->stages, stages, (size_t)n * sizeof(Node *));
+    return p;
+}
+
+static Node *parse_list(Parser *ps, int nested) {
+    Node *list = new_node(ps, NODE_LIST);
+    int cap = 0, op = LIST_SEQ;
+    skip_newlines(ps);
+    for (;;) {
+        Node *p = parse_pipeline(ps);
+        if (ps->err) return NULL;
+        if (!p) {
+            // an empty list, or a trailing ; or &
+            int at_end = ps->tok.type == T_END || (nested && ps->tok.type == T_RPAREN);
+            if (op != LIST_SEQ || !at_end) { syntax_error(ps); return NULL; }
+            break;
+        }
+        if (list->n == cap) {
+            cap = cap ? cap * 2 : 4;
+            ListItem *items = arena_alloc(ps->a, (size_t)cap * sizeof(ListItem));
+            if (list->n) memcpy(items, list->items, (size_t)list->n * sizeof(ListItem));
+            list->items = items;
+        }
+        ListItem *it = &list->items[list->n++];
+        it->pipeline = p;
+        it->op = op;
+        it->background = 0;
+        int t = ps->tok.type;
+        if (t == T_SEMI || t == T_NEWLINE || t == T_AMP) {
+            it->background = t == T_AMP;
+            op = LIST_SEQ;
+            next(ps);
+            skip_newlines(ps);
+        } else if (t == T_AND || t == T_OR) {
+            op = t == T_AND ? LIST_AND : LIST_OR;
+            next(ps);
+            skip_newlines(ps);
+        } else {
+            break;
+        }
+    }
+    return list;
+}
+
+Node *parse_line(const char *line, Arena *a, const char **err) {
+    Parser ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.p = line;
+    ps.a = a;
+    // unquoted words never outgrow their source plus a NUL each
+    ps.out = arena_alloc(a, 2 * strlen(line) + 2);
+    next(&ps);
+    Node *list = parse_list(&ps, 0);
+    if (!ps.err && ps.tok.type != T_END) syntax_error(&ps);
+    if (ps.err) { *err = ps.err; return NULL; }
+    return list;
+}
+
+static Parsed *cache[PARSE_CACHE_SIZE];
+static unsigned long cache_clock;
+
+static uint64_t fnv1a(const char *s) {
+    uint64_t h = 1469598103934665603ull;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211ull;
+    return h;
+}
+
+void parse_release(Parsed *p) {
+    if (--p->refs > 0) return;
+    arena_free(&p->arena);
+    free(p->text);
+    free(p);
+}
+
+Parsed *parse_cached(const char *line, const char **err) {
+    uint64_t h = fnv1a(line);
+    int victim = 0;
+    for (int i = 0; i < PARSE_CACHE_SIZE; i++) {
+        Parsed *p = cache[i];
+        if (p && p->hash == h && strcmp(p->text, line) == 0) {
+            p->used = ++cache_clock;
+            p->refs++;
+            return p;
+        }
+        if (!p || (cache[victim] && p->used < cache[victim]->used)) victim = i;
+    }
+    Parsed *p = calloc(1, sizeof(*p));
+    if (!p) die("calloc");
+    p->list = parse_line(line, &p->arena, err);
+    if (!p->list) { arena_free(&p->arena); free(p); return NULL; }
+    p->text = strdup(line);
+    if (!p->text) die("strdup");
+    p->hash = h;
+    p->used = ++cache_clock;
+    p->refs = 2;
+    // a plan still running an evicted line keeps it alive
+    if (cache[victim]) parse_release(cache[victim]);
+    cache[victim] = p;
+    return p;
+}
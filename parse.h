@@ -0,0 +1,70 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "builtins.h"
+
+// Bump allocator for everything parsed from one command line; freed whole
+typedef struct ArenaBlock ArenaBlock;
+typedef struct {
+    ArenaBlock *head;
+} Arena;
+
+void *arena_alloc(Arena *a, size_t n);
+void arena_free(Arena *a);
+
+// Redirection, applied in order: `n< w`, `n> w`, `n>> w`, `n>&m`, `<<< w`
+enum { REDIR_IN, REDIR_OUT, REDIR_APPEND, REDIR_DUP, REDIR_HERESTR };
+typedef struct Redir {
+    struct Redir *next;
+    int kind;
+    int fd;             // fd being redirected (0-2)
+    int dup_fd;         // REDIR_DUP: fd it becomes a copy of
+    const char *word;   // file name or here-string text
+} Redir;
+
+enum { NODE_CMD, NODE_SUBSHELL, NODE_PIPE, NODE_LIST };
+// How a list item joins the one before it
+enum { LIST_SEQ, LIST_AND, LIST_OR };
+
+typedef struct Node Node;
+typedef struct {
+    Node *pipeline;     // NODE_PIPE
+    int op;             // LIST_SEQ, LIST_AND or LIST_OR
+    int background;     // terminated by '&'
+} ListItem;
+
+struct Node {
+    int type;
+    int n;              // NODE_CMD: argc; NODE_PIPE: stages; NODE_LIST: items
+    char **argv;        // NODE_CMD, NULL-terminated
+    const Builtin *builtin;  // NODE_CMD: resolved at parse time, NULL if external
+    Node **stages;      // NODE_PIPE: NODE_CMD or NODE_SUBSHELL
+    ListItem *items;    // NODE_LIST
+    Node *body;         // NODE_SUBSHELL: NODE_LIST
+    Redir *redirs;      // NODE_CMD and NODE_SUBSHELL
+};
+
+// Parse a command line (words, quotes, |, &&, ||, ;, &, ( ), redirections)
+// into a NODE_LIST allocated from a. On a syntax error returns NULL and
+// points *err at a message.
+Node *parse_line(const char *line, Arena *a, const char **err);
+
+// A parsed line kept in a small LRU keyed by its text, so re-running a
+// command (history, watch loops) skips lexing, parsing and allocation.
+// The tree is read-only and shared; hold a reference while running it.
+typedef struct Parsed {
+    Node *list;
+    char *text;
+    uint64_t hash;
+    Arena arena;
+    int refs;           // the cache's own plus one per user
+    unsigned long used; // LRU clock
+} Parsed;
+
+// Cached parse of line with a reference taken, or NULL with *err set
+Parsed *parse_cached(const char *line, const char **err);
+void parse_release(Parsed *p);
+
+#endif // PARSE_H
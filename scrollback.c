@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include "myterm.h"
+#include "scrollback.h"
+
+struct SbPage {
+    SbPage *next;           // free-list link while pooled
+    char data[SB_PAGE_SIZE];
+};
+
+// Pages are recycled through a process-wide free list shared by all tabs,
+// so steady-state streaming never touches malloc.
+static SbPage *pool_free = NULL;
+
+static SbPage *page_alloc(void) {
+    SbPage *p = pool_free;
+    if (p) { pool_free = p->next; return p; }
+    p = malloc(sizeof(*p));
+    if (!p) die("malloc");
+    return p;
+}
+
+static void page_release(SbPage *p) {
+    p->next = pool_free;
+    pool_free = p;
+}
+
+#define LINE_AT(sb, i) ((sb)->lines[((sb)->lines_head + (i)) & ((sb)->lines_cap - 1)])
+
+static void lines_push(Scrollback *sb, uint64_t start) {
+    if (sb->nstarts == sb->lines_cap) {
+        // grow by doubling and unwrap the ring
+        size_t ncap = sb->lines_cap * 2;
+        uint64_t *nl = malloc(ncap * sizeof(*nl));
+        if (!nl) die("malloc");
+        for (size_t i = 0; i < sb->nstarts; i++) nl[i] = LINE_AT(sb, i);
+        free(sb->lines);
+        sb->lines = nl; sb->lines_cap = ncap; sb->lines_head = 0;
+    }
+    LINE_AT(sb, sb->nstarts) = start;
+    sb->nstarts++;
+    if (sb->nstarts > sb->max_lines + 1) {
+        sb->lines_head = (sb->lines_head + 1) & (sb->lines_cap - 1);
+        sb->nstarts--;
+        sb->first_line++;
+    }
+}
+
+// Drop index entries for lines that ended before the first retained byte.
+static void lines_trim(Scrollback *sb) {
+    while (sb->nstarts > 1 && LINE_AT(sb, 1) <= sb->base) {
+        sb->lines_head = (sb->lines_head + 1) & (sb->lines_cap - 1);
+        sb->nstarts--;
+        sb->first_line++;
+    }
+}
+
+void sb_init(Scrollback *sb, size_t max_bytes, size_t max_lines) {
+    size_t cap = max_bytes / SB_PAGE_SIZE;
+    if (cap < 2) cap = 2;
+    sb->ring = calloc(cap, sizeof(*sb->ring));
+    if (!sb->ring) die("calloc");
+    sb->cap = cap;
+    sb->head = sb->npages = 0;
+    sb->base = sb->end = 0;
+    sb->spare = NULL;
+    sb->lines_cap = 64;
+    sb->lines = malloc(sb->lines_cap * sizeof(*sb->lines));
+    if (!sb->lines) die("malloc");
+    sb->lines_head = 0;
+    sb->lines[0] = 0;
+    sb->nstarts = 1;
+    sb->first_line = 0;
+    sb->max_lines = max_lines ? max_lines : 1;
+}
+
+void sb_clear(Scrollback *sb) {
+    for (size_t i = 0; i < sb->npages; i++) page_release(sb->ring[(sb->head + i) % sb->cap]);
+    sb->head = sb->npages = 0;
+    sb->base = sb->end = 0;
+    sb->lines_head = 0;
+    sb->lines[0] = 0;
+    sb->nstarts = 1;
+    sb->first_line = 0;
+}
+
+void sb_free(Scrollback *sb) {
+    if (!sb->ring) return;
+    sb_clear(sb);
+    if (sb->spare) { page_release(sb->spare); sb->spare = NULL; }
+    free(sb->ring);
+    free(sb->lines);
+    sb->ring = NULL;
+    sb->lines = NULL;
+    sb->cap = sb->lines_cap = 0;
+}
+
+static SbPage *page_at(const Scrollback *sb, uint64_t off) {
+    size_t idx = (size_t)((off - sb->base) / SB_PAGE_SIZE);
+    return sb->ring[(sb->head + idx) % sb->cap];
+}
+
+static size_t tail_used(const Scrollback *sb) {
+    return (size_t)(sb->end - sb->base) - (sb->npages ? (sb->npages - 1) * SB_PAGE_SIZE : 0);
+}
+
+// Link page p in as the new tail, evicting the oldest page if the ring is full
+static void push_page(Scrollback *sb, SbPage *p) {
+    if (sb->npages == sb->cap) {
+        page_release(sb->ring[sb->head]);
+        sb->head = (sb->head + 1) % sb->cap;
+        sb->npages--;
+        sb->base += SB_PAGE_SIZE;
+        lines_trim(sb);
+    }
+    sb->ring[(sb->head + sb->npages) % sb->cap] = p;
+    sb->npages++;
+}
+
+// Account for k bytes already placed in the tail page at offset used
+static void commit_tail(Scrollback *sb, size_t used, size_t k) {
+    char *dst = sb->ring[(sb->head + sb->npages - 1) % sb->cap]->data + used;
+    for (char *p = dst, *e = dst + k; (p = memchr(p, '\n', (size_t)(e - p))) != NULL; p++)
+        lines_push(sb, sb->end + (uint64_t)(p - dst) + 1);
+    sb->end += k;
+}
+
+void sb_append(Scrollback *sb, const char *s, size_t n) {
+    while (n > 0) {
+        size_t used = tail_used(sb);
+        if (sb->npages == 0 || used == SB_PAGE_SIZE) {
+            push_page(sb, page_alloc());
+            used = 0;
+        }
+        size_t k = SB_PAGE_SIZE - used;
+        if (k > n) k = n;
+        memcpy(sb->ring[(sb->head + sb->npages - 1) % sb->cap]->data + used, s, k);
+        commit_tail(sb, used, k);
+        s += k; n -= k;
+    }
+}
+
+int sb_reserve(Scrollback *sb, struct iovec iov[2]) {
+    int k = 0;
+    size_t used = tail_used(sb);
+    if (sb->npages && used < SB_PAGE_SIZE) {
+        iov[k].iov_base = sb->ring[(sb->head + sb->npages - 1) % sb->cap]->data + used;
+        iov[k].iov_len = SB_PAGE_SIZE - used;
+        k++;
+    }
+    if (!sb->spare) sb->spare = page_alloc();
+    iov[k].iov_base = sb->spare->data;
+    iov[k].iov_len = SB_PAGE_SIZE;
+    return k + 1;
+}
+
+void sb_commit(Scrollback *sb, size_t n) {
+    while (n > 0) {
+        size_t used = tail_used(sb);
+        if (sb->npages == 0 || used == SB_PAGE_SIZE) {
+            push_page(sb, sb->spare);
+            sb->spare = NULL;
+            used = 0;
+        }
+        size_t k = SB_PAGE_SIZE - used;
+        if (k > n) k = n;
+        commit_tail(sb, used, k);
+        n -= k;
+    }
+}
+
+const char *sb_span(const Scrollback *sb, uint64_t off, size_t *len) {
+    if (off < sb->base || off >= sb->end) { *len = 0; return NULL; }
+    size_t in_page = (size_t)((off - sb->base) % SB_PAGE_SIZE);
+    size_t n = SB_PAGE_SIZE - in_page;
+    if (n > sb->end - off) n = (size_t)(sb->end - off);
+    *len = n;
+    return page_at(sb, off)->data + in_page;
+}
+
+size_t sb_copy(const Scrollback *sb, uint64_t off, char *dst, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        size_t len; const char *p = sb_span(sb, off + done, &len);
+        if (!p) break;
+        if (len > n - done) len = n - done;
+        memcpy(dst + done, p, len);
+        done += len;
+    }
+    return done;
+}
+
+uint64_t sb_memchr(const Scrollback *sb, uint64_t off, int c) {
+    if (off < sb->base) off = sb->base;
+    while (off < sb->end) {
+        size_t len; const char *p = sb_span(sb, off, &len);
+        const char *hit = memchr(p, c, len);
+        if (hit) return off + (uint64_t)(hit - p);
+        off += len;
+    }
+    return sb->end;
+}
+
+size_t sb_line_count(const Scrollback *sb) {
+    return LINE_AT(sb, sb->nstarts - 1) == sb->end ? sb->nstarts - 1 : sb->nstarts;
+}
+
+void sb_line(const Scrollback *sb, size_t i, uint64_t *start, uint64_t *end) {
+    uint64_t s = LINE_AT(sb, i);
+    *start = s < sb->base ? sb->base : s;
+    *end = i + 1 < sb->nstarts ? LINE_AT(sb, i + 1) - 1 : sb->end;
+    if (*end < *start) *end = *start;
+}
+
+uint64_t sb_tail_line(const Scrollback *sb) {
+    uint64_t s = LINE_AT(sb, sb->nstarts - 1);
+    return s < sb->base ? sb->base : s;
+}
+
+void sb_truncate(Scrollback *sb, uint64_t off) {
+    uint64_t start = sb_tail_line(sb);
+    if (off < start) off = start;
+    if (off >= sb->end) return;
+    // pages left empty go back to the pool; the tail page may end up empty
+    while (sb->npages > 1 && off <= sb->base + (uint64_t)(sb->npages - 1) * SB_PAGE_SIZE) {
+        sb->npages--;
+        page_release(sb->ring[(sb->head + sb->npages) % sb->cap]);
+    }
+    sb->end = off;
+}
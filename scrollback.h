@@ -0,0 +1,69 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Page size of the scrollback store; every page except the newest one is full.
+#ifndef SB_PAGE_SIZE
+#define SB_PAGE_SIZE (64 * 1024)
+#endif
+// Default per-tab cap, overridable at runtime with MYTERM_SCROLLBACK (bytes, K/M suffix ok)
+#ifndef SCROLLBACK_MAX_BYTES
+#define SCROLLBACK_MAX_BYTES (8u * 1024 * 1024)
+#endif
+// Default per-tab line cap, overridable with MYTERM_SCROLLBACK_LINES
+#ifndef SCROLLBACK_MAX_LINES
+#define SCROLLBACK_MAX_LINES 200000
+#endif
+
+typedef struct SbPage SbPage;
+
+// Per-tab scrollback: a ring of fixed-size pages taken from a shared pool.
+// Offsets are absolute byte positions that stay valid while the oldest pages
+// are evicted; [base, end) is what is still retained.
+typedef struct {
+    SbPage **ring;      // page slots, oldest at ring[head]
+    size_t cap;         // slot count == page cap
+    size_t head;
+    size_t npages;
+    SbPage *spare;      // page handed out by sb_reserve, linked in by sb_commit
+    uint64_t base;      // absolute offset of the first retained byte (page aligned)
+    uint64_t end;       // absolute offset one past the last byte
+    // Line index: start offsets of retained lines, kept up to date by sb_append.
+    // The newest start is the (possibly empty) line still being written.
+    uint64_t *lines;
+    size_t lines_cap;   // allocated slots, power of two
+    size_t lines_head;
+    size_t nstarts;
+    size_t max_lines;
+    uint64_t first_line;    // absolute number of line 0, counting evicted lines
+} Scrollback;
+
+void sb_init(Scrollback *sb, size_t max_bytes, size_t max_lines);
+void sb_free(Scrollback *sb);
+void sb_clear(Scrollback *sb);
+void sb_append(Scrollback *sb, const char *s, size_t n);
+// Zero-copy append: sb_reserve exposes the free tail of the newest page plus
+// one spare page for readv(); sb_commit then accounts for the n bytes written.
+int sb_reserve(Scrollback *sb, struct iovec iov[2]);
+void sb_commit(Scrollback *sb, size_t n);
+
+// Contiguous bytes starting at absolute offset off (up to the end of its page).
+const char *sb_span(const Scrollback *sb, uint64_t off, size_t *len);
+// Copy up to n bytes starting at off; returns the number copied.
+size_t sb_copy(const Scrollback *sb, uint64_t off, char *dst, size_t n);
+// Absolute offset of the next byte c at or after off, or sb->end if none.
+uint64_t sb_memchr(const Scrollback *sb, uint64_t off, int c);
+
+// Number of lines; a trailing newline does not open a new visible line.
+size_t sb_line_count(const Scrollback *sb);
+// Bounds of line i (0 = oldest retained), excluding its newline.
+void sb_line(const Scrollback *sb, size_t i, uint64_t *start, uint64_t *end);
+// Start of the last line, the one still being written.
+uint64_t sb_tail_line(const Scrollback *sb);
+// Cut the last line back to absolute offset off (not before its start).
+void sb_truncate(Scrollback *sb, uint64_t off);
+
+#endif // SCROLLBACK_H
@@ -0,0 +1,122 @@
+#!/bin/sh
+# Scripted regressions: each case types commands into MyTerm on the headless
+# backend (MYTERM_SCRIPT, see backend_headless.c) and checks the files those
+# commands leave behind. A UI that blocks never gets to them, and the case
+# fails on its timeout.
+#
+# usage: tests/scripts.sh [path/to/myterm]
+BIN=$(cd "$(dirname "${1:-./myterm}")" && pwd)/$(basename "${1:-./myterm}")
+T=$(mktemp -d "${TMPDIR:-/tmp}/myterm-test.XXXXXX")
+trap 'rm -rf "$T"' EXIT
+failed=0
+
+# run <name>: feed $T/<name>.script to a fresh instance
+run() {
+    if ! (cd "$T" && HOME="$T" MYTERM_BACKEND=headless MYTERM_SCRIPT="$T/$1.script" \
+          timeout 20 "$BIN" >/dev/null 2>&1); then
+        echo "FAIL $1: myterm did not finish (hung or crashed)"
+        failed=1
+        return 1
+    fi
+}
+
+# expect <name> <file> <text>: the case passed if file holds exactly text
+expect() {
+    if [ "$(cat "$T/$2" 2>/dev/null)" = "$3" ]; then echo "ok   $1"
+    else echo "FAIL $1: $2 is '$(cat "$T/$2" 2>/dev/null)', expected '$3'"; failed=1; fi
+}
+
+# Redirection from a FIFO with no writer: the open must block only the
+# child, so Ctrl+C ends it and the next command runs (user-016)
+mkfifo "$T/fifo"
+cat > "$T/fifo_redirect.script" <<EOF
+type /bin/cat < $T/fifo
+key Return
+wait 300
+key ctrl+c
+wait 200
+type : < $T/fifo
+key Return
+wait 300
+key ctrl+c
+wait 200
+type echo alive > $T/fifo_redirect.out
+key Return
+wait 200
+quit
+EOF
+run fifo_redirect && expect fifo_redirect fifo_redirect.out alive
+
+# Redirections still apply in order, in the child
+printf 'x y\n' > "$T/in"
+cat > "$T/redirect_order.script" <<EOF
+type echo b 2>&1 1>$T/order.out; (cat) < $T/in >> $T/order.out; /bin/cat <<< here >> $T/order.out
+key Return
+wait 500
+quit
+EOF
+run redirect_order && expect redirect_order order.out "b
+x y
+here"
+
+# cat's in-process path must not copy an endless stdin: it runs the real
+# cat, which Ctrl+C stops (user-015)
+cat > "$T/cat_stdin.script" <<EOF
+type cat < /dev/zero
+key Return
+wait 300
+key ctrl+c
+wait 200
+type cat < $T/in > $T/cat.out; cat - < $T/in >> $T/cat.out
+key Return
+wait 300
+quit
+EOF
+run cat_stdin && expect cat_stdin cat.out "x y
+x y"
+
+# The same with the output redirected: where the output goes does not
+# make an endless or blocking input safe to read in the UI (user-015)
+cat > "$T/cat_redirected.script" <<EOF
+type cat /dev/zero > /dev/null
+key Return
+wait 300
+key ctrl+c
+wait 200
+type cat < /dev/zero > /dev/null
+key Return
+wait 300
+key ctrl+c
+wait 200
+type cat $T/fifo > $T/fifo.out
+key Return
+wait 300
+key ctrl+c
+wait 200
+type cat $T/in > $T/cat2.out
+key Return
+wait 300
+quit
+EOF
+run cat_redirected && expect cat_redirected cat2.out "x y"
+
+# Closing a tab with background jobs in it, one finished with its output
+# still held (the tab was busy) and one running: both are dropped and the
+# terminal goes on (user-020). The click hits Tab 1's close box on the
+# headless backend's 6-pixel font.
+cat > "$T/tab_close_jobs.script" <<EOF
+type echo hi & (sleep 1; echo late) & sleep 2
+key Return
+wait 300
+click 77 15
+wait 1500
+type jobs > $T/jobs.out; echo alive >> $T/jobs.out
+key Return
+wait 300
+quit
+EOF
+run tab_close_jobs && expect tab_close_jobs jobs.out "No jobs running
+alive"
+
+[ $failed = 0 ] && echo "scripts: all passed"
+exit $failed
@@ -0,0 +1,458 @@
+// Unit checks for the MyTerm core: the scrollback store and its line index,
+// the VT filter and the command line parser.
+// Linked against the same objects as the bench; prints one line per failed
+// check and exits non-zero if there was any.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myterm.h"
+#include "scrollback.h"
+#include "vt.h"
+#include "parse.h"
+
+static int checks, failures;
+
+#define CHECK(cond) do { checks++; if (!(cond)) { failures++; \
+    fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #cond); } } while (0)
+
+// Line i of sb as a string (markers and all)
+static const char *line_of(const Scrollback *sb, size_t i) {
+    static char buf[4096];
+    uint64_t s, e;
+    sb_line(sb, i, &s, &e);
+    size_t n = sb_copy(sb, s, buf, e - s < sizeof(buf) - 1 ? (size_t)(e - s) : sizeof(buf) - 1);
+    buf[n] = '\0';
+    return buf;
+}
+
+// ---- scrollback ----
+static void test_sb_lines(void) {
+    Scrollback sb;
+    sb_init(&sb, 1 << 20, 1000);
+    CHECK(sb_line_count(&sb) == 0);
+    sb_append(&sb, "one\ntwo", 7);
+    CHECK(sb_line_count(&sb) == 2);
+    CHECK(strcmp(line_of(&sb, 0), "one") == 0);
+    CHECK(strcmp(line_of(&sb, 1), "two") == 0);
+    // a trailing newline does not open a visible line
+    sb_append(&sb, "\n", 1);
+    CHECK(sb_line_count(&sb) == 2);
+    CHECK(sb_tail_line(&sb) == sb.end);
+    sb_append(&sb, "\n\nx", 3);
+    CHECK(sb_line_count(&sb) == 5);
+    CHECK(strcmp(line_of(&sb, 2), "") == 0 && strcmp(line_of(&sb, 3), "") == 0);
+    CHECK(strcmp(line_of(&sb, 4), "x") == 0);
+    CHECK(sb_memchr(&sb, 0, 'w') == 5);
+    CHECK(sb_memchr(&sb, 0, 'z') == sb.end);
+    sb_clear(&sb);
+    CHECK(sb_line_count(&sb) == 0 && sb.end == 0);
+    sb_free(&sb);
+}
+
+static void test_sb_pages(void) {
+    // lines that straddle page boundaries read back whole
+    Scrollback sb;
+    sb_init(&sb, 8 * SB_PAGE_SIZE, 100000);
+    char line[100];
+    size_t total = 0;
+    int n = 0;
+    while (total < 3 * SB_PAGE_SIZE) {
+        int len = snprintf(line, sizeof(line), "line %d %.*s\n", n, n % 50, "..................................................");
+        sb_append(&sb, line, (size_t)len);
+        total += (size_t)len;
+        n++;
+    }
+    CHECK(sb.npages == 4);
+    CHECK(sb_line_count(&sb) == (size_t)n);
+    int ok = 1;
+    for (int i = 0; i < n && ok; i++) {
+        snprintf(line, sizeof(line), "line %d %.*s", i, i % 50, "..................................................");
+        ok = strcmp(line_of(&sb, (size_t)i), line) == 0;
+    }
+    CHECK(ok);
+    size_t len;
+    const char *p = sb_span(&sb, SB_PAGE_SIZE - 1, &len);
+    CHECK(p && len == 1);
+    sb_free(&sb);
+}
+
+static void test_sb_evict(void) {
+    // a full ring drops its oldest page and the lines that ended in it
+    Scrollback sb;
+    sb_init(&sb, 2 * SB_PAGE_SIZE, 1000000);
+    char line[16];
+    for (int i = 0; i < 30000; i++) {
+        int len = snprintf(line, sizeof(line), "%07d\n", i);
+        sb_append(&sb, line, (size_t)len);
+    }
+    CHECK(sb.npages == 2);
+    CHECK(sb.base == sb.end - sb.end % SB_PAGE_SIZE - SB_PAGE_SIZE);
+    size_t count = sb_line_count(&sb);
+    CHECK(sb.first_line + count == 30000);
+    CHECK(strcmp(line_of(&sb, count - 1), "0029999") == 0);
+    // the oldest line kept may start before base: it is cut to what is left
+    uint64_t s, e;
+    sb_line(&sb, 0, &s, &e);
+    CHECK(s >= sb.base && e > s);
+    sb_free(&sb);
+
+    // the line cap trims the index without touching the bytes
+    sb_init(&sb, 1 << 20, 10);
+    for (int i = 0; i < 25; i++) {
+        int len = snprintf(line, sizeof(line), "%d\n", i);
+        sb_append(&sb, line, (size_t)len);
+    }
+    CHECK(sb_line_count(&sb) == 10);
+    CHECK(sb.first_line == 15);
+    CHECK(strcmp(line_of(&sb, 0), "15") == 0);
+    sb_free(&sb);
+}
+
+static void test_sb_reserve(void) {
+    // readv-style commits index lines like sb_append, across the spare page
+    Scrollback a, b;
+    sb_init(&a, 1 << 20, 100000);
+    sb_init(&b, 1 << 20, 100000);
+    char chunk[5000];
+    for (size_t i = 0; i < sizeof(chunk); i++) chunk[i] = i % 37 == 36 ? '\n' : (char)('a' + i % 26);
+    for (int round = 0; round < 40; round++) {
+        sb_append(&a, chunk, sizeof(chunk));
+        struct iovec iov[2];
+        int niov = sb_reserve(&b, iov);
+        size_t left = sizeof(chunk), off = 0;
+        for (int k = 0; k < niov && left; k++) {
+            size_t m = iov[k].iov_len < left ? iov[k].iov_len : left;
+            memcpy(iov[k].iov_base, chunk + off, m);
+            off += m; left -= m;
+        }
+        sb_commit(&b, sizeof(chunk));
+    }
+    CHECK(a.end == b.end);
+    CHECK(sb_line_count(&a) == sb_line_count(&b));
+    int same = 1;
+    for (size_t i = 0; i < sb_line_count(&a) && same; i++) {
+        char la[4096];
+        snprintf(la, sizeof(la), "%s", line_of(&a, i));
+        same = strcmp(la, line_of(&b, i)) == 0;
+    }
+    CHECK(same);
+    sb_free(&a);
+    sb_free(&b);
+}
+
+static void test_sb_truncate(void) {
+    Scrollback sb;
+    sb_init(&sb, 1 << 20, 1000);
+    sb_append(&sb, "kept\nprogress 10%", 17);
+    uint64_t start = sb_tail_line(&sb);
+    CHECK(start == 5);
+    sb_truncate(&sb, start);
+    sb_append(&sb, "progress 100%", 13);
+    CHECK(sb_line_count(&sb) == 2);
+    CHECK(strcmp(line_of(&sb, 1), "progress 100%") == 0);
+    // never before the start of the last line
+    sb_truncate(&sb, 0);
+    CHECK(strcmp(line_of(&sb, 0), "kept") == 0 && sb.end == start);
+    // a cut back across a page boundary releases the emptied page
+    sb_clear(&sb);
+    char fill[SB_PAGE_SIZE];
+    memset(fill, 'x', sizeof(fill));
+    sb_append(&sb, "a\n", 2);
+    sb_append(&sb, fill, sizeof(fill));
+    CHECK(sb.npages == 2);
+    sb_truncate(&sb, 2);
+    CHECK(sb.npages == 1 && sb.end == 2);
+    sb_append(&sb, "b", 1);
+    CHECK(strcmp(line_of(&sb, 1), "b") == 0);
+    sb_free(&sb);
+}
+
+// ---- VT filter ----
+// Everything in sb, lines joined by '\n', markers spelled {n} ({-} = default)
+static const char *dump(const Scrollback *sb) {
+    static char out[1 << 16];
+    size_t o = 0;
+    for (size_t i = 0; i < sb_line_count(sb); i++) {
+        const char *l = line_of(sb, i);
+        for (size_t j = 0; l[j] && o < sizeof(out) - 16; j++) {
+            if (l[j] == VT_ATTR && l[j + 1]) {
+                int a = (unsigned char)l[++j] - VT_ATTR_DEFAULT - 1;
+                o += (size_t)(a < 0 ? snprintf(out + o, 16, "{-}") : snprintf(out + o, 16, "{%d}", a));
+            } else {
+                out[o++] = l[j];
+            }
+        }
+        if (i + 1 < sb_line_count(sb)) out[o++] = '\n';
+    }
+    out[o] = '\0';
+    return out;
+}
+
+static const char *filter(const char *in) {
+    static Scrollback sb;
+    if (!sb.ring) sb_init(&sb, 1 << 20, 10000);
+    sb_clear(&sb);
+    Vt vt = {0};
+    vt_write(&vt, &sb, in, strlen(in));
+    return dump(&sb);
+}
+
+static void test_vt_text(void) {
+    CHECK(strcmp(filter("plain\nlines\n"), "plain\nlines") == 0);
+    CHECK(strcmp(filter("a \x1b[31mred\x1b[0m b\n"), "a {1}red{-} b") == 0);
+    CHECK(strcmp(filter("\x1b[1;32mbright\x1b[22mdim\x1b[m\n"), "{10}bright{2}dim{-}") == 0);
+    CHECK(strcmp(filter("\x1b[38;5;9mR\x1b[38;2;1;2;3mT\x1b[39mD\n"), "{9}RT{-}D") == 0);
+    // a colour carries over the newline
+    CHECK(strcmp(filter("\x1b[34mone\ntwo\x1b[0m\n"), "{4}one\n{4}two{-}") == 0);
+    CHECK(strcmp(filter("10%\r20%\r100%\ndone\n"), "100%\ndone") == 0);
+    CHECK(strcmp(filter("line\r\nnext\r\n"), "line\nnext") == 0);
+    CHECK(strcmp(filter("abc\b\bX\n"), "aX") == 0);
+    CHECK(strcmp(filter("a\tb\n12345678\tx\n"), "a       b\n12345678        x") == 0);
+    CHECK(strcmp(filter("abc\b\tx\n\xc3\xa9\tx\n"), "ab      x\n\xc3\xa9       x") == 0);
+    CHECK(strcmp(filter("abcdefghij\rab\tx\n"), "ab      x") == 0);
+    // the column holds however long the line gets
+    static char longline[3000];
+    memset(longline, 'a', 2001);
+    strcpy(longline + 2001, "\tx\n");
+    const char *l = filter(longline);
+    CHECK(strlen(l) == 2009 && strcmp(l + 2001, "       x") == 0);
+    // other sequences are dropped, split or not
+    CHECK(strcmp(filter("\x1b]0;title\x07x\x1b[2K\x1b[?25ly\x1b(Bz\x1b]8;;u\x1b\\w\n"), "xyzw") == 0);
+}
+
+static void test_vt_markers(void) {
+    // SO from a program is dropped, never a marker
+    CHECK(strcmp(filter("a\x0e\x42" "b\x0e\n"), "aBb") == 0);
+    CHECK(strcmp(filter("\x0e\x0f" "ok\n"), "ok") == 0);
+    // text the filter made keeps its markers when fed again
+    Scrollback sb;
+    sb_init(&sb, 1 << 20, 1000);
+    Vt vt = {0};
+    const char marked[] = "x\x0e\x42red\x0e\x40 y\n";
+    vt_write_marked(&vt, &sb, marked, sizeof(marked) - 1);
+    CHECK(strcmp(dump(&sb), "x{1}red{-} y") == 0);
+    // the accent multiWatch -n marks changed lines with is a marker too
+    sb_clear(&sb);
+    vt = (Vt){0};
+    const char accent[] = "\x0e\x51" "new\x0e\x40\n";
+    vt_write_marked(&vt, &sb, accent, sizeof(accent) - 1);
+    CHECK(strcmp(dump(&sb), "{16}new{-}") == 0);
+    // a marker cut in two does not reach into program output
+    sb_clear(&sb);
+    vt = (Vt){0};
+    vt_write_marked(&vt, &sb, "a\x0e", 2);
+    vt_write(&vt, &sb, "\x42" "b\n", 3);
+    CHECK(strcmp(dump(&sb), "aBb") == 0);
+    // vt_line: starts in the colour in effect and ends at the default
+    char out[64];
+    Vt lv = {0};
+    size_t n = vt_line(&lv, "\x1b[32mok\r\x1b[32mOK\tz", 17, out, sizeof(out));
+    sb_clear(&sb);
+    vt = (Vt){0};
+    vt_write_marked(&vt, &sb, out, n);
+    CHECK(strcmp(dump(&sb), "{2}OK      z{-}") == 0);
+    n = vt_line(&lv, "next", 4, out, sizeof(out));
+    CHECK(n == 8 && memcmp(out, "\x0e\x43next", 6) == 0);
+    sb_free(&sb);
+}
+
+// The eight-byte scan must find exactly what a byte at a time finds: feed
+// random text rich in control and high bytes whole, byte by byte (which
+// only takes the scalar tail), in random pieces and through vt_commit
+static void test_vt_swar(void) {
+    static const char alphabet[] = "abc \n\r\b\t\x1b[;31m\x0e\x0f\x80\xc3\xa9\xff\x7f\x01\x1f";
+    static char in[1 << 16];
+    srand(1);
+    for (int round = 0; round < 20; round++) {
+        size_t n = sizeof(in) / 2 + (size_t)(rand() % (int)(sizeof(in) / 2));
+        int dense = round % 2;
+        for (size_t i = 0; i < n; i++)
+            in[i] = dense || rand() % 16 == 0 ? alphabet[rand() % (int)(sizeof(alphabet) - 1)] : (char)('a' + rand() % 26);
+        Scrollback whole, bytes, pieces, commit;
+        Vt v1 = {0}, v2 = {0}, v3 = {0}, v4 = {0};
+        sb_init(&whole, 1 << 20, 100000);
+        sb_init(&bytes, 1 << 20, 100000);
+        sb_init(&pieces, 1 << 20, 100000);
+        sb_init(&commit, 1 << 20, 100000);
+        vt_write(&v1, &whole, in, n);
+        for (size_t i = 0; i < n; i++) vt_write(&v2, &bytes, in + i, 1);
+        for (size_t i = 0, k; i < n; i += k) {
+            k = 1 + (size_t)(rand() % 40);
+            if (k > n - i) k = n - i;
+            vt_write(&v3, &pieces, in + i, k);
+        }
+        for (size_t i = 0, k; i < n; i += k) {
+            struct iovec iov[2];
+            int niov = sb_reserve(&commit, iov);
+            k = 1 + (size_t)(rand() % 5000);
+            if (k > n - i) k = n - i;
+            size_t off = 0;
+            for (int j = 0; j < niov && off < k; j++) {
+                size_t m = iov[j].iov_len < k - off ? iov[j].iov_len : k - off;
+                memcpy(iov[j].iov_base, in + i + off, m);
+                off += m;
+            }
+            vt_commit(&v4, &commit, iov, niov, k);
+        }
+        int same = whole.end == bytes.end && whole.end == pieces.end && whole.end == commit.end;
+        char a[4096], b[4096];
+        for (uint64_t off = 0; same && off < whole.end; off += sizeof(a)) {
+            size_t m = sb_copy(&whole, off, a, sizeof(a));
+            same = sb_copy(&bytes, off, b, sizeof(b)) == m && memcmp(a, b, m) == 0 &&
+                   sb_copy(&pieces, off, b, sizeof(b)) == m && memcmp(a, b, m) == 0 &&
+                   sb_copy(&commit, off, b, sizeof(b)) == m && memcmp(a, b, m) == 0;
+        }
+        CHECK(same);
+        // no raw SO survives: every one left starts a marker
+        int stray = 0;
+        for (uint64_t off = 0; off < whole.end; off++) {
+            char ch[2];
+            if (sb_copy(&whole, off, ch, 2) >= 1 && ch[0] == VT_ATTR) {
+                unsigned char m = (unsigned char)ch[1];
+                stray |= m < VT_ATTR_DEFAULT || m > VT_ATTR_DEFAULT + VT_COLORS;
+                off++;
+            }
+        }
+        CHECK(!stray);
+        sb_free(&whole); sb_free(&bytes); sb_free(&pieces); sb_free(&commit);
+    }
+}
+
+// ---- parser ----
+// The tree as text: words in <>, redirections as fd op word, subshells in ()
+static size_t show_list(const Node *list, char *out, size_t o, size_t cap);
+
+static size_t put_str(char *out, size_t o, size_t cap, const char *s) {
+    int n = snprintf(out + o, cap - o, "%s", s);
+    return n < 0 ? o : o + (size_t)n < cap ? o + (size_t)n : cap - 1;
+}
+
+static size_t show_command(const Node *c, char *out, size_t o, size_t cap) {
+    static const char *const ops[] = { "<", ">", ">>", ">&", "<<<" };
+    if (c->type == NODE_SUBSHELL) {
+        o = put_str(out, o, cap, "(");
+        o = show_list(c->body, out, o, cap);
+        o = put_str(out, o, cap, ")");
+    }
+    for (int i = 0; i < c->n; i++) {
+        o = put_str(out, o, cap, "<");
+        o = put_str(out, o, cap, c->argv[i]);
+        o = put_str(out, o, cap, ">");
+    }
+    for (const Redir *r = c->redirs; r; r = r->next) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s%d%s", o ? " " : "", r->fd, ops[r->kind]);
+        o = put_str(out, o, cap, buf);
+        o = put_str(out, o, cap, r->word);
+    }
+    return o;
+}
+
+static size_t show_list(const Node *list, char *out, size_t o, size_t cap) {
+    static const char *const ops[] = { " ; ", " && ", " || " };
+    for (int i = 0; i < list->n; i++) {
+        const ListItem *it = &list->items[i];
+        if (i > 0) o = put_str(out, o, cap, ops[it->op]);
+        for (int k = 0; k < it->pipeline->n; k++) {
+            if (k > 0) o = put_str(out, o, cap, " | ");
+            o = show_command(it->pipeline->stages[k], out, o, cap);
+        }
+        if (it->background) o = put_str(out, o, cap, " &");
+    }
+    return o;
+}
+
+// The parse of line as text, or "error: ..."
+static const char *parsed(const char *line) {
+    static char out[1024];
+    Arena a = {0};
+    const char *err = NULL;
+    Node *list = parse_line(line, &a, &err);
+    if (list) out[show_list(list, out, 0, sizeof(out))] = '\0';
+    else snprintf(out, sizeof(out), "error: %s", err ? err : "(none)");
+    arena_free(&a);
+    return out;
+}
+
+static int is_error(const char *line) {
+    return strncmp(parsed(line), "error: ", 7) == 0;
+}
+
+static void test_parse_words(void) {
+    CHECK(strcmp(parsed("echo  hello\tworld "), "<echo><hello><world>") == 0);
+    CHECK(strcmp(parsed("echo 'a b' \"c\\\"d\" e\\ f x'y'\"z\""), "<echo><a b><c\"d><e f><xyz>") == 0);
+    CHECK(strcmp(parsed("echo \"\\$HOME\" '\\n'"), "<echo><$HOME><\\n>") == 0);
+    CHECK(strcmp(parsed(""), "") == 0);
+    CHECK(is_error("echo 'open"));
+    CHECK(is_error("echo \"open"));
+}
+
+static void test_parse_structure(void) {
+    CHECK(strcmp(parsed("a | b && c || d ; e &"), "<a> | <b> && <c> || <d> ; <e> &") == 0);
+    CHECK(strcmp(parsed("a &b"), "<a> & ; <b>") == 0);
+    CHECK(strcmp(parsed("a;"), "<a>") == 0);
+    CHECK(strcmp(parsed("a\nb |\n c"), "<a> ; <b> | <c>") == 0);
+    CHECK(strcmp(parsed("(cd /; ls) | wc"), "(<cd></> ; <ls>) | <wc>") == 0);
+    CHECK(strcmp(parsed("((a) && b)"), "((<a>) && <b>)") == 0);
+    CHECK(is_error("a |"));
+    CHECK(is_error("| a"));
+    CHECK(is_error("a && "));
+    CHECK(is_error("a ;; b"));
+    CHECK(is_error("(a"));
+    CHECK(is_error("a)"));
+    CHECK(is_error("()"));
+    CHECK(strcmp(parsed("a ||"), "error: syntax error: unexpected end of line") == 0);
+    CHECK(strcmp(parsed("a | | b"), "error: syntax error near `|'") == 0);
+}
+
+static void test_parse_redirs(void) {
+    CHECK(strcmp(parsed("cat < in > out"), "<cat> 0<in 1>out") == 0);
+    CHECK(strcmp(parsed("cmd 2>>log 2>&1 <<< 'here string'"), "<cmd> 2>>log 2>&1 0<<<here string") == 0);
+    CHECK(strcmp(parsed("a 1>f2 b"), "<a><b> 1>f2") == 0);
+    CHECK(strcmp(parsed("(a; b) > out 2>&1"), "(<a> ; <b>) 1>out 2>&1") == 0);
+    // digits are an fd only right before the operator
+    CHECK(strcmp(parsed("echo 2 >f"), "<echo><2> 1>f") == 0);
+    CHECK(strcmp(parsed("> f"), "1>f") == 0);
+    CHECK(is_error("a >"));
+    CHECK(is_error("a 3> f"));
+    CHECK(is_error("a >& 5"));
+    CHECK(is_error("a > | b"));
+}
+
+static void test_parse_cache(void) {
+    // builtins are resolved at parse time
+    Arena a = {0};
+    const char *err = NULL;
+    Node *list = parse_line("cat x | /bin/cat", &a, &err);
+    CHECK(list && list->items[0].pipeline->stages[0]->builtin != NULL);
+    CHECK(list && list->items[0].pipeline->stages[1]->builtin == NULL);
+    arena_free(&a);
+    // the same text shares one tree until the last reference goes
+    Parsed *p1 = parse_cached("echo cached | wc", &err);
+    Parsed *p2 = parse_cached("echo cached | wc", &err);
+    CHECK(p1 && p1 == p2 && p1->refs == 3);
+    Parsed *p3 = parse_cached("echo other", &err);
+    CHECK(p3 && p3 != p1);
+    CHECK(parse_cached("echo 'bad", &err) == NULL && err != NULL);
+    parse_release(p1);
+    parse_release(p2);
+    parse_release(p3);
+}
+
+int main(void) {
+    test_sb_lines();
+    test_sb_pages();
+    test_sb_evict();
+    test_sb_reserve();
+    test_sb_truncate();
+    test_vt_text();
+    test_vt_markers();
+    test_vt_swar();
+    test_parse_words();
+    test_parse_structure();
+    test_parse_redirs();
+    test_parse_cache();
+    printf("unit: %d checks, %d failed\n", checks, failures);
+    return failures != 0;
+}
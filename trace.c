@@ -0,0 +1,122 @@
+// Command launch latency: monotonic milestones per command, kept for the
+// `timing` builtin and optionally streamed as Chrome trace-event JSON
+// (load the file in chrome://tracing or Perfetto).
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+#ifndef TRACE_KEEP
+#define TRACE_KEEP 32
+#endif
+
+static Timeline done[TRACE_KEEP];   // ring of settled commands
+static unsigned ndone;
+static FILE *trace_file;
+static int trace_file_tried;
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Time from milestone a to b in ms, or -1 if either was not reached
+static double span_ms(const Timeline *tl, int a, int b) {
+    if (!tl->t[a] || !tl->t[b] || tl->t[b] < tl->t[a]) return -1;
+    return (double)(tl->t[b] - tl->t[a]) / 1e6;
+}
+
+static uint64_t last_mark(const Timeline *tl) {
+    uint64_t last = 0;
+    for (int m = 0; m < TRACE_MARKS; m++) if (tl->t[m] > last) last = tl->t[m];
+    return last;
+}
+
+static void json_str(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static void emit(FILE *f, const char *name, const Timeline *tl, uint64_t from, uint64_t to) {
+    if (!from || !to || to < from) return;
+    fprintf(f, "{\"name\":\"%s\",\"cat\":\"launch\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"cmd\":",
+            name, (double)from / 1e3, (double)(to - from) / 1e3, (int)getpid(), tl->tab + 1);
+    json_str(f, tl->cmd);
+    fputs("}},\n", f);
+}
+
+// Chrome accepts the array format without the closing bracket, so events
+// are appended as they settle and nothing has to run at exit
+static void write_trace(const Timeline *tl) {
+    if (!trace_file_tried) {
+        trace_file_tried = 1;
+        const char *path = getenv("MYTERM_TRACE");
+        if (path && *path && (trace_file = fopen(path, "we")) != NULL) fputs("[\n", trace_file);
+    }
+    if (!trace_file) return;
+    emit(trace_file, "command", tl, tl->t[TRACE_ENTER], last_mark(tl));
+    emit(trace_file, "parse", tl, tl->t[TRACE_ENTER], tl->t[TRACE_PARSED]);
+    emit(trace_file, "spawn", tl, tl->t[TRACE_PARSED], tl->t[TRACE_SPAWNED]);
+    emit(trace_file, "child", tl, tl->t[TRACE_SPAWNED], tl->t[TRACE_FIRST_BYTE]);
+    emit(trace_file, "render", tl, tl->t[TRACE_FIRST_BYTE], tl->t[TRACE_FIRST_PAINT]);
+    fflush(trace_file);
+}
+
+static void finish(Timeline *tl) {
+    tl->open = 0;
+    done[ndone++ % TRACE_KEEP] = *tl;
+    write_trace(tl);
+}
+
+void trace_begin(Timeline *tl, int tab, const char *cmd) {
+    // the previous command exited but never reached the screen
+    if (tl->open && tl->t[TRACE_EXIT]) finish(tl);
+    memset(tl, 0, sizeof(*tl));
+    tl->tab = tab;
+    tl->open = 1;
+    snprintf(tl->cmd, sizeof(tl->cmd), "%s", cmd);
+    tl->t[TRACE_ENTER] = trace_now();
+}
+
+void trace_mark(Timeline *tl, int mark) {
+    if (tl && tl->open && !tl->t[mark]) tl->t[mark] = trace_now();
+}
+
+void trace_settle(Timeline *tl) {
+    if (!tl->open || !tl->t[TRACE_EXIT]) return;
+    if (tl->t[TRACE_FIRST_BYTE] && !tl->t[TRACE_FIRST_PAINT]) return;
+    finish(tl);
+}
+
+static void put_ms(char *buf, size_t n, double ms) {
+    if (ms < 0) snprintf(buf, n, "%9s", "-");
+    else snprintf(buf, n, "%9.3f", ms);
+}
+
+void print_timing_command(BuiltinIO *io) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), "%9s%9s%9s%9s%9s  %s\n", "parse", "spawn", "child", "paint", "total", "command (ms)");
+    builtin_out(io, line, (size_t)n);
+    unsigned first = ndone > TRACE_KEEP ? ndone - TRACE_KEEP : 0;
+    for (unsigned i = first; i < ndone; i++) {
+        const Timeline *tl = &done[i % TRACE_KEEP];
+        char c[5][16];
+        put_ms(c[0], sizeof(c[0]), span_ms(tl, TRACE_ENTER, TRACE_PARSED));
+        put_ms(c[1], sizeof(c[1]), span_ms(tl, TRACE_PARSED, TRACE_SPAWNED));
+        put_ms(c[2], sizeof(c[2]), span_ms(tl, TRACE_SPAWNED, TRACE_FIRST_BYTE));
+        put_ms(c[3], sizeof(c[3]), span_ms(tl, TRACE_FIRST_BYTE, TRACE_FIRST_PAINT));
+        put_ms(c[4], sizeof(c[4]), (double)(last_mark(tl) - tl->t[TRACE_ENTER]) / 1e6);
+        n = snprintf(line, sizeof(line), "%s%s%s%s%s  %s\n", c[0], c[1], c[2], c[3], c[4], tl->cmd);
+        builtin_out(io, line, n < (int)sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "builtins.h"
+
+// Launch milestones of one command, in order
+enum {
+    TRACE_ENTER,        // Return pressed, run_command()
+    TRACE_PARSED,       // command line split and parsed
+    TRACE_SPAWNED,      // every stage launched (or builtin started)
+    TRACE_FIRST_BYTE,   // first output in the scrollback
+    TRACE_FIRST_PAINT,  // first frame showing that output
+    TRACE_EXIT,         // pipeline finished
+    TRACE_MARKS
+};
+
+// Monotonic timestamps (ns, 0 = not reached) of the command a tab runs
+typedef struct {
+    uint64_t t[TRACE_MARKS];
+    int tab;
+    int open;
+    char cmd[96];
+} Timeline;
+
+uint64_t trace_now(void);
+void trace_begin(Timeline *tl, int tab, const char *cmd);
+// Record a milestone the first time it is reached; tl may be NULL
+void trace_mark(Timeline *tl, int mark);
+// Close the timeline once the command has exited and its output is on
+// screen: it joins the `timing` list and, with MYTERM_TRACE=<file>, is
+// written as Chrome trace events.
+void trace_settle(Timeline *tl);
+// The `timing` builtin: per-stage latency of recent commands
+void print_timing_command(BuiltinIO *io);
+
+#endif // TRACE_H
@@ -0,0 +1,299 @@
+// Enable memrchr on glibc
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include "myterm.h"
+#include "vt.h"
+
+enum { GROUND, ESC, ESC_SKIP, CSI, STRING, STRING_ESC, MARK };
+
+// ---- fast path ----
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+// High bit set in each byte of v that is zero (exact for "any byte is zero")
+#define ZERO_BYTES(v) (((v) - ONES) & ~(v) & HIGHS)
+
+static int special(unsigned char c) {
+    return c == 0x1b || c == '\r' || c == '\b' || c == '\t' || c == VT_ATTR || c == 0x0f;
+}
+
+// Length of the prefix of s free of ESC, CR, BS, TAB, SO and SI. Eight
+// bytes per step: BS/TAB and SO/SI differ only in the low bit, so four
+// tests cover all six.
+static size_t plain_run(const char *s, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        // most words have no byte below 0x20 at all; newlines take the long test
+        if (!ZERO_BYTES(w & (ONES * 0xe0))) continue;
+        uint64_t low = w & ~ONES;
+        if (ZERO_BYTES(w ^ (ONES * 0x1b)) | ZERO_BYTES(w ^ (ONES * '\r')) |
+            ZERO_BYTES(low ^ (ONES * '\b')) | ZERO_BYTES(low ^ (ONES * VT_ATTR))) break;
+    }
+    while (i < n && !special((unsigned char)s[i])) i++;
+    return i;
+}
+
+// ---- output ----
+// Filtered text goes to a scrollback or, for vt_line(), a buffer
+typedef struct {
+    Scrollback *sb;
+    char *buf;
+    size_t len, cap;
+} Sink;
+
+static void put(Sink *o, const char *s, size_t n) {
+    if (o->sb) { sb_append(o->sb, s, n); return; }
+    if (n > o->cap - o->len) n = o->cap - o->len;
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static uint64_t line_start(const Sink *o) { return o->sb ? sb_tail_line(o->sb) : 0; }
+static uint64_t line_end(const Sink *o) { return o->sb ? o->sb->end : o->len; }
+
+static void copy_out(const Sink *o, uint64_t off, char *dst, size_t n) {
+    if (o->sb) sb_copy(o->sb, off, dst, n);
+    else memcpy(dst, o->buf + off, n);
+}
+
+static void cut(Sink *o, uint64_t off) {
+    if (o->sb) sb_truncate(o->sb, off);
+    else o->len = (size_t)off;
+}
+
+// Keep vt->col, the column the line has reached, over n bytes of plain
+// text (no markers): counted from the last newline, continuation bytes not
+static void advance(Vt *vt, const char *s, size_t n) {
+    const char *nl = memrchr(s, '\n', n);
+    if (nl) { vt->col = 0; n -= (size_t)(nl + 1 - s); s = nl + 1; }
+    for (size_t i = 0; i < n; i++) vt->col += ((unsigned char)s[i] & 0xc0) != 0x80;
+}
+
+static void marker(Sink *o, unsigned char attr) {
+    char m[2] = { VT_ATTR, (char)(attr ? attr : VT_ATTR_DEFAULT) };
+    put(o, m, 2);
+}
+
+// Text is about to be written: after a CR it replaces the line, keeping
+// the colour in effect
+static void settle_cr(Vt *vt, Sink *o) {
+    if (!vt->cr) return;
+    vt->cr = 0;
+    vt->col = 0;
+    cut(o, line_start(o));
+    if (vt->attr) marker(o, vt->attr);
+}
+
+// BS: drop the last character of the line; markers after it stay
+static void backspace(Vt *vt, Sink *o) {
+    if (vt->cr) return;     // already at the start of the line
+    uint64_t start = line_start(o), end = line_end(o);
+    char tail[32];
+    size_t k = end - start < sizeof(tail) ? (size_t)(end - start) : sizeof(tail);
+    copy_out(o, end - k, tail, k);
+    size_t j = k;
+    while (j >= 2 && tail[j - 2] == VT_ATTR) j -= 2;
+    if (j == 0) return;
+    size_t c = j - 1;
+    // back to the lead byte of the character, but never into a marker
+    // (a stray continuation byte may follow one)
+    while (c > 0 && ((unsigned char)tail[c] & 0xc0) == 0x80 && !(c >= 2 && tail[c - 2] == VT_ATTR)) c--;
+    cut(o, end - (k - c));
+    put(o, tail + j, k - j);
+    if (vt->col) vt->col--;
+}
+
+// TAB: spaces up to the next multiple of 8 columns
+static void tab(Vt *vt, Sink *o) {
+    settle_cr(vt, o);
+    static const char spaces[] = "        ";
+    unsigned k = 8 - vt->col % 8;
+    put(o, spaces, k);
+    vt->col += k;
+}
+
+// ---- escape sequences ----
+// Marker byte for the SGR state, 0 for the default colour
+static unsigned char sgr_attr(const Vt *vt) {
+    if (vt->fg == 0) return 0;
+    int color = vt->fg <= 8 && vt->bold ? vt->fg - 1 + 8 : vt->fg - 1;
+    return (unsigned char)(VT_ATTR_DEFAULT + 1 + color);
+}
+
+static void sgr(Vt *vt, Sink *o) {
+    if (vt->nparam == 0) vt->nparam = 1, vt->param[0] = 0;
+    for (int i = 0; i < vt->nparam; i++) {
+        int p = vt->param[i];
+        if (p == 0) { vt->fg = 0; vt->bold = 0; }
+        else if (p == 1) vt->bold = 1;
+        else if (p == 22) vt->bold = 0;
+        else if (p >= 30 && p <= 37) vt->fg = (unsigned char)(p - 30 + 1);
+        else if (p == 39) vt->fg = 0;
+        else if (p >= 90 && p <= 97) vt->fg = (unsigned char)(p - 90 + 8 + 1);
+        else if (p == 38 || p == 48) {
+            // 38;5;n and 38;2;r;g;b: the 16 base colours of the 256 are kept
+            if (i + 2 < vt->nparam && vt->param[i + 1] == 5) {
+                if (p == 38 && vt->param[i + 2] < VT_COLORS) vt->fg = (unsigned char)(vt->param[i + 2] + 1);
+                i += 2;
+            } else if (i + 1 < vt->nparam && vt->param[i + 1] == 2) {
+                i += 4;
+            }
+        }
+    }
+    unsigned char attr = sgr_attr(vt);
+    if (attr == vt->attr) return;
+    settle_cr(vt, o);
+    vt->attr = attr;
+    marker(o, attr);
+}
+
+static void escape(Vt *vt, Sink *o, unsigned char c) {
+    switch (vt->state) {
+    case ESC:
+        if (c == '[') { vt->state = CSI; vt->nparam = 0; vt->other = 0; memset(vt->param, 0, sizeof(vt->param)); }
+        else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') { vt->state = STRING; vt->len = 0; }
+        else if (c >= 0x20 && c <= 0x2f) vt->state = ESC_SKIP;    // charset and the like: one more byte
+        else vt->state = GROUND;
+        break;
+    case ESC_SKIP:
+        vt->state = GROUND;
+        break;
+    case CSI:
+        if (c >= '0' && c <= '9') {
+            if (vt->nparam == 0) vt->nparam = 1;
+            int *p = &vt->param[vt->nparam - 1];
+            if (*p < 100000) *p = *p * 10 + (c - '0');
+        } else if (c == ';' || c == ':') {
+            if (vt->nparam == 0) vt->nparam = 1;
+            if (vt->nparam < VT_PARAMS) vt->nparam++;
+        } else if (c >= 0x3c && c <= 0x3f) {
+            vt->other = 1;  // private parameters: ?25h and friends
+        } else if (c >= 0x20 && c <= 0x2f) {
+            vt->other = 1;
+        } else if (c >= 0x40 && c <= 0x7e) {
+            if (c == 'm' && !vt->other) sgr(vt, o);
+            vt->state = GROUND;
+        } else if (c == 0x1b) {
+            vt->state = ESC;
+        } else if (c == 0x18 || c == 0x1a) {
+            vt->state = GROUND;
+        }
+        break;
+    case STRING:
+        // OSC ends with BEL or ST (ESC \); DCS, SOS, PM and APC with ST
+        if (c == 0x07) vt->state = GROUND;
+        else if (c == 0x1b) vt->state = STRING_ESC;
+        else if (++vt->len > VT_STRING_MAX) vt->state = GROUND;
+        break;
+    case STRING_ESC:
+        vt->state = c == '\\' ? GROUND : STRING;
+        break;
+    }
+}
+
+// One control byte in the ground state. SO starts a marker only in text
+// that is already filtered; from a program it is dropped like SI, so
+// output cannot fake a colour.
+static void control(Vt *vt, Sink *o, unsigned char c, int marks) {
+    switch (c) {
+    case 0x1b: vt->state = ESC; break;
+    case '\r': vt->cr = 1; break;
+    case '\b': backspace(vt, o); break;
+    case '\t': tab(vt, o); break;
+    case VT_ATTR: if (marks) vt->state = MARK; break;
+    default: break;     // SI
+    }
+}
+
+static void feed(Vt *vt, Sink *o, const char *s, size_t n, int marks) {
+    while (n > 0) {
+        unsigned char c = (unsigned char)*s;
+        if (vt->state == MARK) {
+            // a marker from an earlier filter (multiWatch panes, -n lines)
+            vt->state = GROUND;
+            if (c >= VT_ATTR_DEFAULT && c <= VT_ATTR_ACCENT) {
+                settle_cr(vt, o);
+                vt->attr = c == VT_ATTR_DEFAULT ? 0 : c;
+                marker(o, vt->attr);
+                s++; n--;
+            }
+            continue;
+        }
+        if (vt->state != GROUND) { escape(vt, o, c); s++; n--; continue; }
+        size_t r = plain_run(s, n);
+        if (r == 0) { control(vt, o, c, marks); s++; n--; continue; }
+        // a CR followed by a newline only ends the line
+        if (vt->cr && *s == '\n') vt->cr = 0;
+        settle_cr(vt, o);
+        if (vt->attr) {
+            // a colour runs on across lines: restate it after each newline
+            const char *nl = memchr(s, '\n', r);
+            if (nl) {
+                size_t k = (size_t)(nl - s) + 1;
+                put(o, s, k);
+                vt->col = 0;
+                marker(o, vt->attr);
+                s += k; n -= k;
+                continue;
+            }
+        }
+        put(o, s, r);
+        advance(vt, s, r);
+        s += r; n -= r;
+    }
+}
+
+void vt_write(Vt *vt, Scrollback *sb, const char *s, size_t n) {
+    Sink o = { .sb = sb };
+    feed(vt, &o, s, n, 0);
+}
+
+void vt_write_marked(Vt *vt, Scrollback *sb, const char *s, size_t n) {
+    Sink o = { .sb = sb };
+    feed(vt, &o, s, n, 1);
+    // a marker cut in two is not finished by the next program output
+    if (vt->state == MARK) vt->state = GROUND;
+}
+
+void vt_commit(Vt *vt, Scrollback *sb, const struct iovec *iov, int niov, size_t n) {
+    size_t clean = 0;
+    if (vt->state == GROUND && !vt->cr && !vt->attr) {
+        for (int k = 0; k < niov && clean < n; k++) {
+            size_t len = iov[k].iov_len < n - clean ? iov[k].iov_len : n - clean;
+            size_t r = plain_run(iov[k].iov_base, len);
+            advance(vt, iov[k].iov_base, r);
+            clean += r;
+            if (r < len) break;
+        }
+    }
+    if (clean == n) { sb_commit(sb, n); return; }
+    // the rest is copied out before filtered text is written over it
+    static char rest[2 * SB_PAGE_SIZE];
+    size_t got = 0, skip = clean;
+    for (int k = 0; k < niov && got < n - clean; k++) {
+        size_t len = iov[k].iov_len;
+        if (skip >= len) { skip -= len; continue; }
+        size_t m = len - skip < n - clean - got ? len - skip : n - clean - got;
+        memcpy(rest + got, (char *)iov[k].iov_base + skip, m);
+        got += m;
+        skip = 0;
+    }
+    sb_commit(sb, clean);
+    vt_write(vt, sb, rest, got);
+}
+
+size_t vt_line(Vt *vt, const char *s, size_t n, char *out, size_t cap) {
+    Sink o = { .buf = out, .cap = cap };
+    vt->cr = 0;
+    vt->col = 0;
+    if (vt->attr) marker(&o, vt->attr);
+    feed(vt, &o, s, n, 0);
+    vt->cr = 0;
+    if (vt->attr && cap >= 2) {
+        if (o.len > cap - 2) o.len = cap - 2;
+        marker(&o, 0);
+    }
+    return o.len;
+}
@@ -0,0 +1,62 @@
+#ifndef VT_H
+#define VT_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include "scrollback.h"
+
+// VT filter between child output and the scrollback. Text goes through
+// unchanged; CR, BS and TAB are applied to the line being written; SGR
+// colours become in-band markers; every other escape sequence is dropped.
+// The fast path skips runs of bytes that are none of ESC, CR, BS, TAB,
+// SO and SI eight at a time, so plain output costs one scan.
+
+// Colour marker: VT_ATTR followed by VT_ATTR_DEFAULT (back to the line's
+// own colour) or VT_ATTR_DEFAULT + 1 + n for ANSI colour n (0-15). The
+// renderer draws the text after it in that colour up to the next marker or
+// the end of the line; every line starts in the default colour.
+// VT_ATTR_ACCENT, the UI's accent colour, is never made from SGR: multiWatch
+// -n marks changed lines with it.
+#define VT_ATTR 0x0e
+#define VT_ATTR_DEFAULT 0x40
+#define VT_COLORS 16
+#define VT_ATTR_ACCENT (VT_ATTR_DEFAULT + 1 + VT_COLORS)
+
+// Numeric CSI parameters kept; further ones are ignored
+#ifndef VT_PARAMS
+#define VT_PARAMS 16
+#endif
+// OSC and other strings longer than this are given up on
+#ifndef VT_STRING_MAX
+#define VT_STRING_MAX 4096
+#endif
+
+typedef struct {
+    unsigned char state;    // where in an escape sequence the input is
+    unsigned char cr;       // CR seen: the next text replaces the line
+    unsigned char attr;     // marker byte in effect, 0 for the default
+    unsigned char fg;       // SGR colour + 1, 0 for the default
+    unsigned char bold;
+    unsigned char other;    // private or intermediate bytes: the CSI is not SGR
+    int nparam;
+    int param[VT_PARAMS];
+    unsigned len;           // bytes of the string being skipped
+    unsigned col;           // characters on the line so far, for TAB
+} Vt;
+
+// Feed n bytes of child output to scrollback sb. A raw SO byte in it is
+// dropped, never taken for a marker.
+void vt_write(Vt *vt, Scrollback *sb, const char *s, size_t n);
+// The same for text this filter already produced (multiWatch panes and -n
+// lines): its markers are kept
+void vt_write_marked(Vt *vt, Scrollback *sb, const char *s, size_t n);
+// n bytes readv() placed in the iovecs from sb_reserve(): plain text is
+// committed where it lies, only what follows the first control byte is
+// copied out and filtered
+void vt_commit(Vt *vt, Scrollback *sb, const struct iovec *iov, int niov, size_t n);
+// Filter one line held in memory into out (cap bytes); returns its length.
+// vt carries the colour from one line to the next: the result starts with
+// the colour in effect and ends back at the default.
+size_t vt_line(Vt *vt, const char *s, size_t n, char *out, size_t cap);
+
+#endif // VT_H